@@ -0,0 +1,194 @@
+#pragma once
+
+// Packed texture archive written by tools/assetpack at build time.
+//
+// Layout: header, table of contents, then the pixel data of every entry.
+// Each entry starts on a page boundary and each mip level on a 16 byte
+// boundary, so levels can be handed to glTexImage2D straight from a
+// read-only mapping of the file.
+
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <fstream>
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char ASSET_ARCHIVE_MAGIC[4] = { 'P', 'T', 'A', 'A' };
+static const uint32_t ASSET_ARCHIVE_VERSION = 1;
+static const uint32_t ASSET_ARCHIVE_MAX_LEVELS = 16;
+static const uint32_t ASSET_ARCHIVE_NAME_LENGTH = 64;
+static const uint64_t ASSET_ARCHIVE_ENTRY_ALIGNMENT = 4096;
+static const uint64_t ASSET_ARCHIVE_LEVEL_ALIGNMENT = 16;
+
+// pixel formats, block compressed formats would be added here
+enum AssetFormat {
+    ASSET_FORMAT_RGB8 = 0,
+    ASSET_FORMAT_RGBA8 = 1
+};
+
+struct AssetArchiveHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t num_entries;
+    uint32_t reserved;
+    uint64_t toc_offset;
+};
+
+struct AssetArchiveLevel {
+    uint64_t offset;    // from the start of the file
+    uint32_t width;
+    uint32_t height;
+    uint32_t size;      // in bytes, rows are tightly packed
+    uint32_t reserved;
+};
+
+struct AssetArchiveEntry {
+    char name[ASSET_ARCHIVE_NAME_LENGTH];   // file name without directories
+    uint32_t format;
+    uint32_t num_levels;
+    AssetArchiveLevel levels[ASSET_ARCHIVE_MAX_LEVELS];
+};
+
+inline uint64_t AssetArchiveAlign(uint64_t offset, uint64_t alignment) {
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+// strips the directories from a path, entries are looked up by file name
+inline std::string AssetArchiveName(const std::string &path) {
+    size_t slash = path.find_last_of("/\\");
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+// Read-only view of an archive, mapped in memory where the platform allows
+class AssetArchive {
+
+    private:
+        const unsigned char *data_ = nullptr;
+        uint64_t size_ = 0;
+        const AssetArchiveEntry *entries_ = nullptr;
+        uint32_t num_entries_ = 0;
+#ifdef _WIN32
+        std::vector<unsigned char> buffer_;
+#endif
+
+    public:
+        ~AssetArchive() {
+            Close();
+        }
+
+        // returns false if the archive is missing or malformed
+        bool Open(const char *path) {
+            Close();
+
+#ifdef _WIN32
+            std::ifstream stream(path, std::ios::in | std::ios::binary);
+            if (!stream.is_open()) {
+                return false;
+            }
+            buffer_.assign(std::istreambuf_iterator<char>(stream),
+                           std::istreambuf_iterator<char>());
+            data_ = buffer_.empty() ? nullptr : &buffer_[0];
+            size_ = buffer_.size();
+#else
+            int fd = open(path, O_RDONLY);
+            if (fd < 0) {
+                return false;
+            }
+            struct stat info;
+            if (fstat(fd, &info) != 0 || info.st_size == 0) {
+                close(fd);
+                return false;
+            }
+            void *mapping = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+            if (mapping == MAP_FAILED) {
+                return false;
+            }
+            data_ = (const unsigned char *) mapping;
+            size_ = info.st_size;
+#endif
+
+            if (!validate()) {
+                fprintf(stderr, "Invalid asset archive: %s\n", path);
+                Close();
+                return false;
+            }
+            return true;
+        }
+
+        void Close() {
+#ifdef _WIN32
+            buffer_.clear();
+#else
+            if (data_ != nullptr) {
+                munmap((void *) data_, size_);
+            }
+#endif
+            data_ = nullptr;
+            size_ = 0;
+            entries_ = nullptr;
+            num_entries_ = 0;
+        }
+
+        bool IsOpen() const {
+            return data_ != nullptr;
+        }
+
+        // returns nullptr if the archive holds no entry with that file name
+        const AssetArchiveEntry *Find(const std::string &path) const {
+            std::string name = AssetArchiveName(path);
+            for (uint32_t i = 0; i < num_entries_; ++i) {
+                if (name == entries_[i].name) {
+                    return &entries_[i];
+                }
+            }
+            return nullptr;
+        }
+
+        const unsigned char *LevelData(const AssetArchiveLevel &level) const {
+            return data_ + level.offset;
+        }
+
+    private:
+        bool validate() {
+            if (size_ < sizeof(AssetArchiveHeader)) {
+                return false;
+            }
+            const AssetArchiveHeader *header = (const AssetArchiveHeader *) data_;
+            if (memcmp(header->magic, ASSET_ARCHIVE_MAGIC, 4) != 0 ||
+                header->version != ASSET_ARCHIVE_VERSION) {
+                return false;
+            }
+            uint64_t toc_end = header->toc_offset +
+                               (uint64_t) header->num_entries * sizeof(AssetArchiveEntry);
+            if (toc_end > size_) {
+                return false;
+            }
+
+            entries_ = (const AssetArchiveEntry *) (data_ + header->toc_offset);
+            num_entries_ = header->num_entries;
+            for (uint32_t i = 0; i < num_entries_; ++i) {
+                const AssetArchiveEntry &entry = entries_[i];
+                if (entry.num_levels == 0 || entry.num_levels > ASSET_ARCHIVE_MAX_LEVELS ||
+                    entry.name[ASSET_ARCHIVE_NAME_LENGTH - 1] != '\0') {
+                    return false;
+                }
+                for (uint32_t l = 0; l < entry.num_levels; ++l) {
+                    if (entry.levels[l].offset + entry.levels[l].size > size_) {
+                        return false;
+                    }
+                }
+            }
+            return true;
+        }
+};
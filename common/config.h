@@ -25,6 +25,15 @@ static const glm::vec3 INITIAL_FRONT = glm::vec3(0.0f, 0.0f, 1.0f);
 static const glm::vec3 INITIAL_UP = glm::vec3(0.0f, 1.0f, 0.0f);
 static const glm::vec2 INITIAL_CENTER = glm::vec2(0.0, 0.0);
 
+// idle mode
+#define IDLE_REDRAW_FRAMES 3        // frames rendered after an input, the gui needs a few
+#define IDLE_WATER_FPS 10.0f        // water animation rate while the view is static
+
+// heightmap tile cache
+#define TILES_PER_VIEW 4            // tiles across the heightmap, whose size sets the page size
+#define PREFETCH_SECONDS 3.0f       // look-ahead along the Bezier paths
+#define TILE_CACHE_PAGES 64         // resident tiles, at least (TILES_PER_VIEW + 3)^2 with the prefetched ones
+
 // world parameters
 #define WORLD_SIZE 500.0f
 #define RESOLUTION 500.0f
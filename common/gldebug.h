@@ -0,0 +1,129 @@
+#pragma once
+
+// GL errors and driver warnings (performance, deprecated behavior) reported
+// through KHR_debug. Unlike check_error_gl() nothing is polled: the driver
+// calls back, only for the severities asked for. The callback runs on a
+// driver thread unless the output is synchronous, which is slower but puts
+// the offending call on the stack of the callback for a debugger.
+//
+//     gldebug::Enable(GL_DEBUG_SEVERITY_LOW, false);
+
+#include <GL/glew.h>
+
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace gldebug {
+
+static const int MAX_REPEATS = 5;       // per message id, later ones are counted only
+
+struct DebugState {
+    std::mutex mutex;
+    std::map<GLuint, int> repeats;
+    int messages = 0;
+};
+
+inline DebugState& State() {
+    static DebugState state;
+    return state;
+}
+
+inline const char* SourceName(GLenum source) {
+    switch (source) {
+        case GL_DEBUG_SOURCE_API: return "api";
+        case GL_DEBUG_SOURCE_WINDOW_SYSTEM: return "window system";
+        case GL_DEBUG_SOURCE_SHADER_COMPILER: return "shader compiler";
+        case GL_DEBUG_SOURCE_THIRD_PARTY: return "third party";
+        case GL_DEBUG_SOURCE_APPLICATION: return "application";
+        default: return "other";
+    }
+}
+
+inline const char* TypeName(GLenum type) {
+    switch (type) {
+        case GL_DEBUG_TYPE_ERROR: return "error";
+        case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "deprecated";
+        case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR: return "undefined behavior";
+        case GL_DEBUG_TYPE_PORTABILITY: return "portability";
+        case GL_DEBUG_TYPE_PERFORMANCE: return "performance";
+        case GL_DEBUG_TYPE_MARKER: return "marker";
+        default: return "other";
+    }
+}
+
+inline const char* SeverityName(GLenum severity) {
+    switch (severity) {
+        case GL_DEBUG_SEVERITY_HIGH: return "high";
+        case GL_DEBUG_SEVERITY_MEDIUM: return "medium";
+        case GL_DEBUG_SEVERITY_LOW: return "low";
+        default: return "notification";
+    }
+}
+
+// GL_NONE for an unknown name
+inline GLenum SeverityFromName(const std::string &name) {
+    const GLenum severities[] = { GL_DEBUG_SEVERITY_HIGH, GL_DEBUG_SEVERITY_MEDIUM,
+                                  GL_DEBUG_SEVERITY_LOW, GL_DEBUG_SEVERITY_NOTIFICATION };
+    for (GLenum severity : severities) {
+        if (name == SeverityName(severity)) {
+            return severity;
+        }
+    }
+    return GL_NONE;
+}
+
+inline void APIENTRY callback(GLenum source, GLenum type, GLuint id, GLenum severity,
+                              GLsizei length, const GLchar* message, GLvoid* /*user_param*/) {
+    DebugState &state = State();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    state.messages++;
+    int repeats = ++state.repeats[id];
+    if (repeats > MAX_REPEATS) {
+        return;
+    }
+    fprintf(stderr, "GL %s %s (%s, id %u): %.*s%s\n", SeverityName(severity), TypeName(type),
+            SourceName(source), id, (int) length, message,
+            repeats == MAX_REPEATS ? " [repeated, muting this id]" : "");
+}
+
+// reports the messages of min_severity and above, returns false when the
+// context has no debug output
+inline bool Enable(GLenum min_severity, bool synchronous) {
+    if (!GLEW_VERSION_4_3 && !GLEW_KHR_debug) {
+        fprintf(stderr, "No KHR_debug, GL debug output is off\n");
+        return false;
+    }
+
+    glEnable(GL_DEBUG_OUTPUT);
+    if (synchronous) {
+        glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+    } else {
+        glDisable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+    }
+    glDebugMessageCallback(callback, NULL);
+
+    // filtered by the driver, the others never reach the callback
+    const GLenum severities[] = { GL_DEBUG_SEVERITY_HIGH, GL_DEBUG_SEVERITY_MEDIUM,
+                                  GL_DEBUG_SEVERITY_LOW, GL_DEBUG_SEVERITY_NOTIFICATION };
+    bool enabled = true;
+    for (GLenum severity : severities) {
+        glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, severity, 0, NULL, enabled);
+        enabled = enabled && severity != min_severity;
+    }
+    return true;
+}
+
+inline void Disable() {
+    glDisable(GL_DEBUG_OUTPUT);
+    glDebugMessageCallback(NULL, NULL);
+}
+
+// received since Enable, muted repeats included
+inline int Messages() {
+    std::lock_guard<std::mutex> lock(State().mutex);
+    return State().messages;
+}
+
+}
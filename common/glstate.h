@@ -0,0 +1,230 @@
+#pragma once
+
+// Filters redundant GL state changes. The cache mirrors the state set through
+// it, so every program, vertex array, texture and framebuffer bind of the
+// renderer goes through it, as well as the deletes (a deleted name is
+// unbound by GL and may be handed out again). Code that changes this state
+// directly and doesn't restore it must call Invalidate() afterwards.
+//
+//     glstate::State().UseProgram(program_id_);
+//     glstate::State().BindTexture(1, GL_TEXTURE_2D, normal_texture_id_);
+
+#include <GL/glew.h>
+
+#include "gpumemory.h"
+
+namespace glstate {
+
+enum CallType {
+    CALL_PROGRAM,
+    CALL_VERTEX_ARRAY,
+    CALL_TEXTURE,
+    CALL_CAPABILITY,
+    CALL_POLYGON_MODE,
+    CALL_FRAMEBUFFER,
+    CALL_TYPES
+};
+
+static const char* CALL_TYPE_NAMES[CALL_TYPES] = {
+    "Program", "Vertex array", "Texture", "Enable/Disable", "Polygon mode", "Framebuffer"
+};
+
+static const int MAX_TEXTURE_UNITS = 16;
+static const int MAX_CAPABILITIES = 8;      // tracked, the others are always issued
+static const GLuint UNKNOWN = 0xFFFFFFFF;
+
+class StateCache {
+
+    private:
+        GLuint program_;
+        GLuint vertex_array_;
+        GLuint active_unit_;
+        GLenum texture_targets_[MAX_TEXTURE_UNITS];     // target of the last bind
+        GLuint textures_[MAX_TEXTURE_UNITS];
+        GLenum capabilities_[MAX_CAPABILITIES];
+        int capability_states_[MAX_CAPABILITIES];       // -1 unknown
+        int num_capabilities_ = 0;
+        GLenum polygon_mode_;
+        GLuint draw_framebuffer_;
+        GLuint read_framebuffer_;
+
+        int issued_[CALL_TYPES];            // current frame
+        int skipped_[CALL_TYPES];
+        int last_issued_[CALL_TYPES];       // previous frame
+        int last_skipped_[CALL_TYPES];
+
+    public:
+        StateCache() {
+            Invalidate();
+            for (int i = 0; i < CALL_TYPES; ++i) {
+                issued_[i] = skipped_[i] = last_issued_[i] = last_skipped_[i] = 0;
+            }
+        }
+
+        // forgets everything, the next call of each kind is issued
+        void Invalidate() {
+            program_ = vertex_array_ = active_unit_ = UNKNOWN;
+            for (int unit = 0; unit < MAX_TEXTURE_UNITS; ++unit) {
+                texture_targets_[unit] = GL_NONE;
+                textures_[unit] = UNKNOWN;
+            }
+            for (int i = 0; i < num_capabilities_; ++i) {
+                capability_states_[i] = -1;
+            }
+            polygon_mode_ = GL_NONE;
+            draw_framebuffer_ = read_framebuffer_ = UNKNOWN;
+        }
+
+        // keeps the counts of the frame that ends for Issued and Skipped
+        void EndFrame() {
+            for (int i = 0; i < CALL_TYPES; ++i) {
+                last_issued_[i] = issued_[i];
+                last_skipped_[i] = skipped_[i];
+                issued_[i] = skipped_[i] = 0;
+            }
+        }
+
+        void UseProgram(GLuint program) {
+            if (count(CALL_PROGRAM, program != program_)) {
+                glUseProgram(program);
+                program_ = program;
+            }
+        }
+
+        void BindVertexArray(GLuint vertex_array) {
+            if (count(CALL_VERTEX_ARRAY, vertex_array != vertex_array_)) {
+                glBindVertexArray(vertex_array);
+                vertex_array_ = vertex_array;
+            }
+        }
+
+        // binds to the given unit, which becomes the active one
+        void BindTexture(int unit, GLenum target, GLuint texture) {
+            if (unit >= MAX_TEXTURE_UNITS) {
+                // not tracked
+                glActiveTexture(GL_TEXTURE0 + unit);
+                glBindTexture(target, texture);
+                active_unit_ = UNKNOWN;
+                issued_[CALL_TEXTURE] += 2;
+                return;
+            }
+            if (count(CALL_TEXTURE, (GLuint) unit != active_unit_)) {
+                glActiveTexture(GL_TEXTURE0 + unit);
+                active_unit_ = unit;
+            }
+            if (count(CALL_TEXTURE, target != texture_targets_[unit] ||
+                                    texture != textures_[unit])) {
+                glBindTexture(target, texture);
+                texture_targets_[unit] = target;
+                textures_[unit] = texture;
+            }
+        }
+
+        void Enable(GLenum capability) {
+            setCapability(capability, 1);
+        }
+
+        void Disable(GLenum capability) {
+            setCapability(capability, 0);
+        }
+
+        // core profiles only accept GL_FRONT_AND_BACK
+        void PolygonMode(GLenum mode) {
+            if (count(CALL_POLYGON_MODE, mode != polygon_mode_)) {
+                glPolygonMode(GL_FRONT_AND_BACK, mode);
+                polygon_mode_ = mode;
+            }
+        }
+
+        void BindFramebuffer(GLenum target, GLuint framebuffer) {
+            bool draw = target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER;
+            bool read = target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER;
+            if (count(CALL_FRAMEBUFFER, (draw && framebuffer != draw_framebuffer_) ||
+                                        (read && framebuffer != read_framebuffer_))) {
+                glBindFramebuffer(target, framebuffer);
+                draw_framebuffer_ = draw ? framebuffer : draw_framebuffer_;
+                read_framebuffer_ = read ? framebuffer : read_framebuffer_;
+            }
+        }
+
+        void DeleteProgram(GLuint program) {
+            glDeleteProgram(program);
+            program_ = program == program_ ? UNKNOWN : program_;
+        }
+
+        void DeleteVertexArrays(GLsizei n, const GLuint *vertex_arrays) {
+            glDeleteVertexArrays(n, vertex_arrays);
+            for (GLsizei i = 0; i < n; ++i) {
+                vertex_array_ = vertex_arrays[i] == vertex_array_ ? UNKNOWN : vertex_array_;
+            }
+        }
+
+        // also removes them from the memory estimate
+        void DeleteTextures(GLsizei n, const GLuint *textures) {
+            glDeleteTextures(n, textures);
+            for (GLsizei i = 0; i < n; ++i) {
+                gpumemory::Registry().Release(GL_TEXTURE, textures[i]);
+                for (int unit = 0; unit < MAX_TEXTURE_UNITS; ++unit) {
+                    textures_[unit] = textures[i] == textures_[unit] ? UNKNOWN : textures_[unit];
+                }
+            }
+        }
+
+        void DeleteFramebuffers(GLsizei n, const GLuint *framebuffers) {
+            glDeleteFramebuffers(n, framebuffers);
+            for (GLsizei i = 0; i < n; ++i) {
+                draw_framebuffer_ = framebuffers[i] == draw_framebuffer_ ? UNKNOWN : draw_framebuffer_;
+                read_framebuffer_ = framebuffers[i] == read_framebuffer_ ? UNKNOWN : read_framebuffer_;
+            }
+        }
+
+        // calls of the previous frame
+        int Issued(int type) const {
+            return last_issued_[type];
+        }
+
+        int Skipped(int type) const {
+            return last_skipped_[type];
+        }
+
+    private:
+        // returns whether the call must be issued
+        bool count(int type, bool changed) {
+            if (changed) {
+                issued_[type]++;
+            } else {
+                skipped_[type]++;
+            }
+            return changed;
+        }
+
+        void setCapability(GLenum capability, int state) {
+            int index = 0;
+            while (index < num_capabilities_ && capabilities_[index] != capability) {
+                index++;
+            }
+            if (index == num_capabilities_ && num_capabilities_ < MAX_CAPABILITIES) {
+                capabilities_[num_capabilities_] = capability;
+                capability_states_[num_capabilities_++] = -1;
+            }
+            bool tracked = index < num_capabilities_;
+            if (count(CALL_CAPABILITY, !tracked || capability_states_[index] != state)) {
+                if (state) {
+                    glEnable(capability);
+                } else {
+                    glDisable(capability);
+                }
+                if (tracked) {
+                    capability_states_[index] = state;
+                }
+            }
+        }
+};
+
+// one per thread would be needed with several contexts, there is one
+inline StateCache& State() {
+    static StateCache state;
+    return state;
+}
+
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+// Estimated GPU memory of the textures, render targets and buffers created
+// by the renderer. The driver adds padding and alignment we can't see, so
+// the sizes are what the data needs: texels times the bytes of the internal
+// format (RGB8 counts as 4, drivers pad it), a third more for mip chains.
+// Only used from the GL thread.
+//
+//     gpumemory::Registry().Track(GL_BUFFER, vbo, gpumemory::MEMORY_BUFFERS, "Water grid", size);
+//     gpumemory::Registry().Release(GL_BUFFER, vbo);
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace gpumemory {
+
+enum Category {
+    MEMORY_TEXTURES,
+    MEMORY_RENDER_TARGETS,
+    MEMORY_BUFFERS,
+    MEMORY_CATEGORIES
+};
+
+static const char* CATEGORY_NAMES[MEMORY_CATEGORIES] = {
+    "Textures", "Render targets", "Buffers"
+};
+
+inline size_t BytesPerTexel(GLint internal_format) {
+    switch (internal_format) {
+        case GL_R8:
+            return 1;
+        case GL_R16:
+        case GL_R16F:
+            return 2;
+        case GL_RGBA32F:
+            return 16;
+        case GL_RGB32F:
+            return 12;
+        case GL_RGBA16F:
+            return 8;
+        default:            // RGB8, RGBA8, R32F, DEPTH_COMPONENT32
+            return 4;
+    }
+}
+
+inline size_t TextureBytes(GLint internal_format, int width, int height, bool mipmapped = false) {
+    size_t bytes = (size_t) width * height * BytesPerTexel(internal_format);
+    return mipmapped ? bytes * 4 / 3 : bytes;
+}
+
+struct Allocation {
+    GLenum type;                // GL_TEXTURE, GL_RENDERBUFFER or GL_BUFFER
+    GLuint name;
+    int category;
+    std::string label;
+    size_t bytes;
+};
+
+class MemoryRegistry {
+
+    private:
+        std::vector<Allocation> allocations_;
+        size_t bytes_[MEMORY_CATEGORIES];
+        size_t peak_bytes_[MEMORY_CATEGORIES];
+
+    public:
+        MemoryRegistry() {
+            std::fill(bytes_, bytes_ + MEMORY_CATEGORIES, 0);
+            std::fill(peak_bytes_, peak_bytes_ + MEMORY_CATEGORIES, 0);
+        }
+
+        // records an allocation, or its new size when the object is re-specified
+        void Track(GLenum type, GLuint name, int category, const std::string &label, size_t bytes) {
+            Release(type, name);
+            Allocation allocation = { type, name, category, label, bytes };
+            allocations_.push_back(allocation);
+            bytes_[category] += bytes;
+            peak_bytes_[category] = std::max(peak_bytes_[category], bytes_[category]);
+        }
+
+        // the object was deleted, unknown names are ignored
+        void Release(GLenum type, GLuint name) {
+            for (size_t i = 0; i < allocations_.size(); ++i) {
+                if (allocations_[i].type == type && allocations_[i].name == name) {
+                    bytes_[allocations_[i].category] -= allocations_[i].bytes;
+                    allocations_.erase(allocations_.begin() + i);
+                    return;
+                }
+            }
+        }
+
+        size_t Bytes(int category) const {
+            return bytes_[category];
+        }
+
+        size_t PeakBytes(int category) const {
+            return peak_bytes_[category];
+        }
+
+        size_t TotalBytes() const {
+            size_t total = 0;
+            for (int i = 0; i < MEMORY_CATEGORIES; ++i) {
+                total += bytes_[i];
+            }
+            return total;
+        }
+
+        // largest first
+        std::vector<Allocation> Allocations() const {
+            std::vector<Allocation> sorted = allocations_;
+            std::sort(sorted.begin(), sorted.end(), [](const Allocation &a, const Allocation &b) {
+                return a.bytes > b.bytes;
+            });
+            return sorted;
+        }
+
+        void Print(FILE *out) const {
+            fprintf(out, "GPU memory estimate: %.2f MB\n", TotalBytes() / 1e6);
+            for (int i = 0; i < MEMORY_CATEGORIES; ++i) {
+                fprintf(out, "  %-16s %8.2f MB (peak %.2f MB)\n", CATEGORY_NAMES[i],
+                        bytes_[i] / 1e6, peak_bytes_[i] / 1e6);
+            }
+            std::vector<Allocation> sorted = Allocations();
+            for (size_t i = 0; i < sorted.size(); ++i) {
+                fprintf(out, "    %8.2f MB  %-16s %s\n", sorted[i].bytes / 1e6,
+                        CATEGORY_NAMES[sorted[i].category], sorted[i].label.c_str());
+            }
+        }
+};
+
+inline MemoryRegistry& Registry() {
+    static MemoryRegistry registry;
+    return registry;
+}
+
+}
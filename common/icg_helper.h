@@ -7,11 +7,25 @@
 #include <vector>
 #include <string>
 #include <cstdlib>
+#include <cstdint>
+#include <cstring>
 #include <algorithm>
 
 // GL Error checking
 #include "check_error_gl.h"
 
+// GL errors and driver warnings through KHR_debug
+#include "gldebug.h"
+
+// Scoped markers for the Chrome trace export
+#include "trace.h"
+
+// Redundant state change filter
+#include "glstate.h"
+
+// GPU memory estimates per category
+#include "gpumemory.h"
+
 // Small library to load images
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -46,6 +60,160 @@ static const glm::mat4 IDENTITY_MATRIX = glm::mat4(1.0f);
 
 namespace icg_helper {
 
+// program binaries are cached in the working directory, one file per program
+static const char* PROGRAM_CACHE_PREFIX = "program_cache_";
+static const uint32_t PROGRAM_CACHE_MAGIC = 0x50434348; // "PCCH"
+static const uint32_t PROGRAM_CACHE_VERSION = 1;
+
+struct ProgramCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;       // hash of the sources and the driver strings
+    uint32_t format;    // binary format returned by the driver
+    uint32_t length;    // size of the binary following the header
+};
+
+// true if the current context exposes the given extension
+inline bool HasExtension(const char* name) {
+    GLint num_extensions = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &num_extensions);
+    for(GLint i = 0; i < num_extensions; ++i) {
+        const char* extension = (const char*) glGetStringi(GL_EXTENSIONS, i);
+        if(extension != NULL && strcmp(extension, name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// 64 bit FNV-1a, chained through the hash argument
+inline uint64_t HashBytes(uint64_t hash, const void* data, size_t size) {
+    const unsigned char* bytes = (const unsigned char*) data;
+    for(size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+inline uint64_t HashString(uint64_t hash, const char* str) {
+    // hash the terminator too, so that NULL, "" and adjacent strings differ
+    if(str == NULL) {
+        return HashBytes(hash, "\xff", 1);
+    }
+    return HashBytes(hash, str, strlen(str) + 1);
+}
+
+inline bool ProgramBinarySupported() {
+    static int supported = -1;
+    if(supported < 0) {
+        GLint num_formats = 0;
+        if(GLEW_VERSION_4_1 || HasExtension("GL_ARB_get_program_binary")) {
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+        }
+        supported = num_formats > 0 ? 1 : 0;
+    }
+    return supported == 1;
+}
+
+// the key changes whenever a source or the driver changes
+inline uint64_t ProgramCacheKey(const char* const* sources, int count) {
+    uint64_t hash = 14695981039346656037ull;
+    hash = HashString(hash, (const char*) glGetString(GL_VENDOR));
+    hash = HashString(hash, (const char*) glGetString(GL_RENDERER));
+    hash = HashString(hash, (const char*) glGetString(GL_VERSION));
+    for(int i = 0; i < count; ++i) {
+        hash = HashString(hash, sources[i]);
+    }
+    return hash;
+}
+
+// the file name only depends on the shader paths, so that editing a shader
+// overwrites its stale binary instead of adding a new one
+inline string ProgramCachePath(const char* const* paths, int count) {
+    uint64_t hash = 14695981039346656037ull;
+    for(int i = 0; i < count; ++i) {
+        hash = HashString(hash, paths[i]);
+    }
+    char name[17];
+    snprintf(name, sizeof(name), "%016llx", (unsigned long long) hash);
+    return string(PROGRAM_CACHE_PREFIX) + name + ".bin";
+}
+
+// returns 0 if there is no valid binary for this key
+inline GLuint LoadCachedProgram(const string& path, uint64_t key) {
+    TRACE_SCOPE_DETAIL("Load cached program", path.c_str());
+    const int SHADER_LOAD_FAILED = 0;
+    if(!ProgramBinarySupported()) {
+        return SHADER_LOAD_FAILED;
+    }
+
+    ifstream cache_stream(path.c_str(), ios::in | ios::binary);
+    if(!cache_stream.is_open()) {
+        return SHADER_LOAD_FAILED;
+    }
+
+    ProgramCacheHeader header;
+    cache_stream.read((char*) &header, sizeof(header));
+    // an empty binary is a truncated or corrupt cache
+    if(!cache_stream || header.magic != PROGRAM_CACHE_MAGIC ||
+       header.version != PROGRAM_CACHE_VERSION || header.key != key || header.length == 0) {
+        return SHADER_LOAD_FAILED;
+    }
+
+    vector<char> binary(header.length);
+    cache_stream.read(binary.data(), header.length);
+    if(!cache_stream) {
+        return SHADER_LOAD_FAILED;
+    }
+
+    // the driver may still reject the binary, e.g. after an update that
+    // kept the version string
+    GLuint program_id = glCreateProgram();
+    glProgramBinary(program_id, header.format, binary.data(), header.length);
+    GLint success = GL_FALSE;
+    glGetProgramiv(program_id, GL_LINK_STATUS, &success);
+    if(!success) {
+        glDeleteProgram(program_id);
+        return SHADER_LOAD_FAILED;
+    }
+
+    fprintf(stdout, "Loaded cached shader program: %s\n", path.c_str());
+    fflush(stdout);
+    return program_id;
+}
+
+inline void SaveCachedProgram(const string& path, uint64_t key, GLuint program_id) {
+    if(!ProgramBinarySupported()) {
+        return;
+    }
+
+    GLint length = 0;
+    glGetProgramiv(program_id, GL_PROGRAM_BINARY_LENGTH, &length);
+    if(length <= 0) {
+        return;
+    }
+
+    vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(program_id, length, NULL, &format, &binary[0]);
+
+    ProgramCacheHeader header;
+    header.magic = PROGRAM_CACHE_MAGIC;
+    header.version = PROGRAM_CACHE_VERSION;
+    header.key = key;
+    header.format = format;
+    header.length = length;
+
+    ofstream cache_stream(path.c_str(), ios::out | ios::binary | ios::trunc);
+    if(!cache_stream.is_open()) {
+        printf("Could not write program cache: %s\n", path.c_str());
+        return;
+    }
+    cache_stream.write((const char*) &header, sizeof(header));
+    cache_stream.write(&binary[0], length);
+}
+
 // compiles the vertex, geometry and fragment shaders stored in the given strings
 inline GLuint CompileShaders(const char* vshader,
                              const char* fshader,
@@ -53,6 +221,7 @@ inline GLuint CompileShaders(const char* vshader,
                              const char* teshader,
                              const char* gshader = NULL
                              ) {
+    TRACE_SCOPE("Compile shaders");
     const int SHADER_LOAD_FAILED = 0;
     GLint success = GL_FALSE;
     int info_log_length;
@@ -189,6 +358,9 @@ inline GLuint CompileShaders(const char* vshader,
     if(teshader != NULL) glAttachShader(program_id, tessellation_evaluation_shader_id);
     if(gshader  != NULL) glAttachShader(program_id, geometry_shader_id);
     glAttachShader(program_id, fragment_shader_id);
+    if(ProgramBinarySupported()) {
+        glProgramParameteri(program_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
     glLinkProgram(program_id);
 
     // Check the program
@@ -217,13 +389,14 @@ inline GLuint CompileShaders(const char* vshader,
 }
 
 
-// compiles the vertex, geometry and fragment shaders using file path
-// TODO: add support for tessellation shaders
+// compiles the vertex, geometry and fragment shaders using file path,
+// reusing the cached program binary when sources and driver are unchanged
 inline GLuint LoadShaders(const char * vertex_file_path,
                           const char * fragment_file_path,
                           const char* tcs_file_path,
                           const char* tes_file_path,
                           const char * geometry_file_path = NULL) {
+    TRACE_SCOPE_DETAIL("Load shaders", vertex_file_path);
     const int SHADER_LOAD_FAILED = 0;
 
     string vertex_shader_code, fragment_shader_code, geometry_shader_code, tcs_shader_code, tes_shader_code;
@@ -298,13 +471,110 @@ inline GLuint LoadShaders(const char * vertex_file_path,
     char const *tes_source_pointer = NULL;
     if(tes_file_path != NULL) tes_source_pointer = tes_shader_code.c_str();
     char const *geometry_source_pointer = NULL;
-    if(geometry_file_path != NULL) geometry_source_pointer = geometry_shader_code.c_str();    
+    if(geometry_file_path != NULL) geometry_source_pointer = geometry_shader_code.c_str();
+
+    // try the program binary cache first
+    const char* paths[] = { vertex_file_path, fragment_file_path, tcs_file_path,
+                            tes_file_path, geometry_file_path };
+    const char* sources[] = { vertex_source_pointer, fragment_source_pointer, tcs_source_pointer,
+                              tes_source_pointer, geometry_source_pointer };
+    string cache_path = ProgramCachePath(paths, 5);
+    uint64_t cache_key = ProgramCacheKey(sources, 5);
+    GLuint cached_program = LoadCachedProgram(cache_path, cache_key);
+    if(cached_program != SHADER_LOAD_FAILED) {
+        return cached_program;
+    }
 
     int status = CompileShaders(vertex_source_pointer, fragment_source_pointer, tcs_source_pointer, tes_source_pointer,
                                 geometry_source_pointer);
     if(status == SHADER_LOAD_FAILED)
         printf("Failed linking:\n  vshader: %s\n  fshader: %s\n tcshader: %s\n teshader: %s\n gshader: %s\n",
                vertex_file_path, fragment_file_path, tcs_file_path, tes_file_path, geometry_file_path);
+    else
+        SaveCachedProgram(cache_path, cache_key, status);
+    return status;
+}
+
+// compiles a compute shader stored in the given string, needs OpenGL 4.3
+inline GLuint CompileComputeShader(const char* cshader) {
+    TRACE_SCOPE("Compile compute shader");
+    const int SHADER_LOAD_FAILED = 0;
+    GLint success = GL_FALSE;
+    int info_log_length;
+
+    GLuint compute_shader_id = glCreateShader(GL_COMPUTE_SHADER);
+
+    fprintf(stdout, "Compiling Compute shader: ");
+    glShaderSource(compute_shader_id, 1, &cshader, NULL);
+    glCompileShader(compute_shader_id);
+
+    glGetShaderiv(compute_shader_id, GL_COMPILE_STATUS, &success);
+    glGetShaderiv(compute_shader_id, GL_INFO_LOG_LENGTH, &info_log_length);
+    if(!success) {
+        vector<char> compute_shader_error_message(max(info_log_length, int(1)));
+        glGetShaderInfoLog(compute_shader_id, info_log_length, NULL,
+                           &compute_shader_error_message[0]);
+        fprintf(stdout, "Failed:\n%s\n", &compute_shader_error_message[0]);
+        glDeleteShader(compute_shader_id);
+        return SHADER_LOAD_FAILED;
+    }
+    else
+        fprintf(stdout, "Success\n");
+
+    fprintf(stdout, "Linking shader program: ");
+    GLuint program_id = glCreateProgram();
+    glAttachShader(program_id, compute_shader_id);
+    if(ProgramBinarySupported()) {
+        glProgramParameteri(program_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+    glLinkProgram(program_id);
+    glDeleteShader(compute_shader_id);
+
+    glGetProgramiv(program_id, GL_LINK_STATUS, &success);
+    glGetProgramiv(program_id, GL_INFO_LOG_LENGTH, &info_log_length);
+    vector<char> program_error_message(max(info_log_length, int(1)));
+    glGetProgramInfoLog(program_id, info_log_length, NULL, &program_error_message[0]);
+    if(!success) {
+        fprintf(stdout, "Failed:\n%s\n", &program_error_message[0]);
+        glDeleteProgram(program_id);
+        return SHADER_LOAD_FAILED;
+    }
+    else {
+        fprintf(stdout, "Success\n");
+    }
+
+    fflush(stdout);
+    return program_id;
+}
+
+// compiles the compute shader at the given path, through the program cache
+// like LoadShaders
+inline GLuint LoadComputeShader(const char* compute_file_path) {
+    TRACE_SCOPE_DETAIL("Load compute shader", compute_file_path);
+    const int SHADER_LOAD_FAILED = 0;
+
+    ifstream compute_shader_stream(compute_file_path, ios::in);
+    if(!compute_shader_stream.is_open()) {
+        printf("Could not open file: %s\n", compute_file_path);
+        return SHADER_LOAD_FAILED;
+    }
+    string compute_shader_code = string(istreambuf_iterator<char>(compute_shader_stream),
+                                        istreambuf_iterator<char>());
+
+    const char* paths[] = { compute_file_path };
+    const char* sources[] = { compute_shader_code.c_str() };
+    string cache_path = ProgramCachePath(paths, 1);
+    uint64_t cache_key = ProgramCacheKey(sources, 1);
+    GLuint cached_program = LoadCachedProgram(cache_path, cache_key);
+    if(cached_program != SHADER_LOAD_FAILED) {
+        return cached_program;
+    }
+
+    GLuint status = CompileComputeShader(sources[0]);
+    if(status == SHADER_LOAD_FAILED)
+        printf("Failed linking:\n  cshader: %s\n", compute_file_path);
+    else
+        SaveCachedProgram(cache_path, cache_key, status);
     return status;
 }
 }
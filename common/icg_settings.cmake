@@ -53,6 +53,20 @@ macro(copy_files_once)
     endforeach()
 endmacro()
 
+# Pack textures and their mip chains into assets.pack on every build
+# (needs the assetpack tool, see tools/assetpack)
+macro(pack_textures_to_build_dir)
+    set(TEXTURES "${ARGN}")
+    get_filename_component(EXERCISENAME ${CMAKE_CURRENT_LIST_DIR} NAME)
+    set(ARCHIVE ${CMAKE_CURRENT_BINARY_DIR}/assets.pack)
+    add_custom_command(
+        OUTPUT ${ARCHIVE}
+        COMMAND assetpack ${ARCHIVE} ${TEXTURES}
+        DEPENDS assetpack ${TEXTURES}
+        COMMENT "Packing textures into ${ARCHIVE}")
+    add_custom_target(pack_textures_${EXERCISENAME} ALL DEPENDS ${ARCHIVE})
+endmacro()
+
 # OPENGL
 find_package(OpenGL REQUIRED)
 include_directories(${OpenGL_INCLUDE_DIRS})
@@ -76,7 +90,20 @@ endif()
 # to problems if an older glm version is already installed).
 add_definitions(-DGLM_FORCE_RADIANS)
 
+# EGL (optional, window-less context for the benchmark mode)
+find_path(EGL_INCLUDE_DIR EGL/egl.h)
+find_library(EGL_LIBRARY NAMES EGL)
+if(EGL_INCLUDE_DIR AND EGL_LIBRARY)
+    message(STATUS "EGL found, headless benchmark enabled")
+    include_directories(${EGL_INCLUDE_DIR})
+    add_definitions(-DHAVE_EGL)
+    set(EGL_LIBRARIES ${EGL_LIBRARY})
+endif()
+
+# THREADS (background texture decoding)
+find_package(Threads REQUIRED)
+
 # Common headers/libraries for all the exercises
 include_directories(${CMAKE_CURRENT_LIST_DIR})
-SET(COMMON_LIBS ${OPENGL_LIBRARIES} ${GLFW3_LIBRARIES} ${GLEW_LIBRARIES})
+SET(COMMON_LIBS ${OPENGL_LIBRARIES} ${GLFW3_LIBRARIES} ${GLEW_LIBRARIES} ${EGL_LIBRARIES} ${CMAKE_THREAD_LIBS_INIT})
 
@@ -0,0 +1,219 @@
+#pragma once
+
+// Scoped trace markers, exported as Chrome trace JSON (chrome://tracing or
+// ui.perfetto.dev). Every thread appends to its own chunked buffer without
+// locking; chunks are published with release stores, so the trace can be
+// written while other threads keep recording.
+//
+//     TRACE_SCOPE("Upload");
+//     TRACE_SCOPE_DETAIL("Decode", filename.c_str());
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace trace {
+
+static const int TRACE_NAME_LENGTH = 32;
+static const int TRACE_DETAIL_LENGTH = 64;
+static const int TRACE_CHUNK_SIZE = 1024;           // events per allocation
+static const int TRACE_MAX_CHUNKS = 256;            // per thread, later events are dropped
+
+struct TraceEvent {
+    char name[TRACE_NAME_LENGTH];
+    char detail[TRACE_DETAIL_LENGTH];
+    int64_t start_ns;
+    int64_t duration_ns;
+};
+
+struct TraceChunk {
+    TraceEvent events[TRACE_CHUNK_SIZE];
+    std::atomic<int> count;
+    std::atomic<TraceChunk*> next;
+
+    TraceChunk() : count(0), next(nullptr) {}
+};
+
+// buffers are kept until exit, a thread may finish before the trace is written
+struct TraceThread {
+    int id;
+    std::string name;           // guarded by the registry mutex
+    TraceChunk *head;
+    TraceChunk *tail;           // only used by the owning thread
+    int num_chunks;
+};
+
+struct TraceRegistry {
+    std::mutex mutex;
+    std::vector<TraceThread*> threads;
+    std::atomic<bool> enabled;
+    std::chrono::steady_clock::time_point epoch;
+
+    TraceRegistry() : enabled(false), epoch(std::chrono::steady_clock::now()) {}
+};
+
+inline TraceRegistry& Registry() {
+    static TraceRegistry registry;
+    return registry;
+}
+
+inline void Enable(bool enable) {
+    Registry().enabled.store(enable, std::memory_order_relaxed);
+}
+
+inline bool IsEnabled() {
+    return Registry().enabled.load(std::memory_order_relaxed);
+}
+
+// nanoseconds since the first use of the tracer
+inline int64_t Now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - Registry().epoch).count();
+}
+
+// buffer of the calling thread, registered on first use
+inline TraceThread& CurrentThread() {
+    static thread_local TraceThread *current = nullptr;
+    if (current == nullptr) {
+        TraceRegistry &registry = Registry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        current = new TraceThread();
+        current->id = registry.threads.size() + 1;
+        current->name = "Thread " + std::to_string(current->id);
+        current->head = current->tail = new TraceChunk();
+        current->num_chunks = 1;
+        registry.threads.push_back(current);
+    }
+    return *current;
+}
+
+inline void SetThreadName(const std::string &name) {
+    TraceThread &thread = CurrentThread();
+    std::lock_guard<std::mutex> lock(Registry().mutex);
+    thread.name = name;
+}
+
+inline void Record(const char *name, const char *detail, int64_t start_ns, int64_t end_ns) {
+
+    TraceThread &thread = CurrentThread();
+    TraceChunk *chunk = thread.tail;
+    int index = chunk->count.load(std::memory_order_relaxed);
+    if (index == TRACE_CHUNK_SIZE) {
+        if (thread.num_chunks == TRACE_MAX_CHUNKS) {
+            return;
+        }
+        TraceChunk *next = new TraceChunk();
+        chunk->next.store(next, std::memory_order_release);
+        thread.tail = chunk = next;
+        thread.num_chunks++;
+        index = 0;
+    }
+
+    TraceEvent &event = chunk->events[index];
+    strncpy(event.name, name, TRACE_NAME_LENGTH - 1);
+    event.name[TRACE_NAME_LENGTH - 1] = '\0';
+    strncpy(event.detail, detail != nullptr ? detail : "", TRACE_DETAIL_LENGTH - 1);
+    event.detail[TRACE_DETAIL_LENGTH - 1] = '\0';
+    event.start_ns = start_ns;
+    event.duration_ns = end_ns - start_ns;
+    chunk->count.store(index + 1, std::memory_order_release);
+}
+
+inline std::string EscapeJson(const char *text) {
+    std::string result;
+    for (const char *c = text; *c != '\0'; ++c) {
+        if (*c == '"' || *c == '\\') {
+            result += '\\';
+            result += *c;
+        } else if ((unsigned char) *c >= 0x20) {
+            result += *c;
+        }
+    }
+    return result;
+}
+
+// writes everything recorded so far, returns false if the file can't be written
+inline bool Write(const char *path) {
+
+    FILE *file = fopen(path, "w");
+    if (file == nullptr) {
+        fprintf(stderr, "Could not write %s\n", path);
+        return false;
+    }
+
+    TraceRegistry &registry = Registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    size_t num_events = 0;
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (size_t t = 0; t < registry.threads.size(); ++t) {
+        const TraceThread &thread = *registry.threads[t];
+        fprintf(file, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%d,"
+                      "\"args\":{\"name\":\"%s\"}}",
+                t == 0 ? "" : ",\n", thread.id, EscapeJson(thread.name.c_str()).c_str());
+
+        for (const TraceChunk *chunk = thread.head; chunk != nullptr;
+             chunk = chunk->next.load(std::memory_order_acquire)) {
+            int count = chunk->count.load(std::memory_order_acquire);
+            for (int i = 0; i < count; ++i) {
+                const TraceEvent &event = chunk->events[i];
+                fprintf(file, ",\n{\"ph\":\"X\",\"name\":\"%s\",\"pid\":1,\"tid\":%d,"
+                              "\"ts\":%.3f,\"dur\":%.3f",
+                        EscapeJson(event.name).c_str(), thread.id,
+                        event.start_ns / 1e3, event.duration_ns / 1e3);
+                if (event.detail[0] != '\0') {
+                    fprintf(file, ",\"args\":{\"detail\":\"%s\"}", EscapeJson(event.detail).c_str());
+                }
+                fprintf(file, "}");
+                num_events++;
+            }
+        }
+    }
+    fprintf(file, "\n]}\n");
+
+    bool ok = ferror(file) == 0;
+    ok = fclose(file) == 0 && ok;
+    if (!ok) {
+        fprintf(stderr, "Error while writing %s\n", path);
+        return false;
+    }
+    printf("Trace with %d events written to %s\n", (int) num_events, path);
+    return true;
+}
+
+// Records the enclosing scope, costs a relaxed load when tracing is disabled.
+// The name and detail must stay valid until the end of the scope.
+class TraceScope {
+
+    private:
+        const char *name_;
+        const char *detail_;
+        int64_t start_ns_;
+
+    public:
+        TraceScope(const char *name, const char *detail = nullptr)
+            : name_(name), detail_(detail), start_ns_(-1) {
+            if (IsEnabled()) {
+                start_ns_ = Now();
+            }
+        }
+
+        ~TraceScope() {
+            if (start_ns_ >= 0) {
+                Record(name_, detail_, start_ns_, Now());
+            }
+        }
+};
+
+}
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) trace::TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#define TRACE_SCOPE_DETAIL(name, detail) \
+    trace::TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name, detail)
@@ -0,0 +1,162 @@
+#pragma once
+#include "proceduralScene.h"
+
+#include <chrono>
+
+struct BenchmarkOptions {
+    int width = WINDOW_WIDTH;
+    int height = WINDOW_HEIGHT;
+    double timestep = 1.0 / 60.0;   // scene seconds per frame
+    int warmup_frames = 30;         // not measured, lets the textures arrive
+    int max_frames = 0;             // 0 plays the whole path once
+    int quality = QUALITY_HIGH;     // fixed preset, never calibrated
+    string output;                  // JSON report, stdout if empty
+};
+
+// Replays the prerecorded flight, the Bezier path or the camera path given
+// with --play-path, with a fixed timestep and reports frame time percentiles
+// and per pass GPU/CPU times as JSON. Expects the scene to be initialized
+// with a current context.
+class Benchmark {
+
+    private:
+        typedef std::chrono::steady_clock Clock;
+
+        struct Stats {
+            double min;
+            double mean;
+            double p50;
+            double p95;
+            double p99;
+            double max;
+        };
+
+        vector<double> frame_ms_;
+        vector<vector<double>> gpu_ms_;     // per pass, per frame
+        vector<vector<double>> cpu_ms_;
+
+    public:
+        int Run(ProceduralScene &scene, const BenchmarkOptions &options) {
+
+            Profiler &profiler = scene.GetProfiler();
+            scene.SetFixedTimestep(options.timestep);
+            // a fixed workload, comparable between machines
+            scene.SetDynamicResolution(false);
+
+            for (int i = 0; i < options.warmup_frames; ++i) {
+                scene.Display();
+            }
+            glFinish();
+
+            scene.StartPrerecordedPath();
+            gpu_ms_.assign(profiler.PassCount(), vector<double>());
+            cpu_ms_.assign(profiler.PassCount(), vector<double>());
+
+            while (scene.CompletedPaths() == 0 &&
+                   (options.max_frames <= 0 || (int) frame_ms_.size() < options.max_frames)) {
+
+                // glFinish makes the wall time include the GPU work of the frame
+                Clock::time_point start = Clock::now();
+                scene.Display();
+                glFinish();
+                frame_ms_.push_back(std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+
+                for (int pass = 0; pass < profiler.PassCount(); ++pass) {
+                    gpu_ms_[pass].push_back(profiler.GpuTime(pass));
+                    cpu_ms_[pass].push_back(profiler.CpuTime(pass));
+                }
+            }
+
+            // the GPU times lag two frames behind, drop the first ones
+            for (int pass = 0; pass < profiler.PassCount(); ++pass) {
+                size_t lag = std::min<size_t>(2, gpu_ms_[pass].size());
+                gpu_ms_[pass].erase(gpu_ms_[pass].begin(), gpu_ms_[pass].begin() + lag);
+            }
+
+            if (frame_ms_.empty()) {
+                fprintf(stderr, "Benchmark rendered no frames\n");
+                return EXIT_FAILURE;
+            }
+            return writeReport(profiler, options) ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+
+    private:
+        static Stats computeStats(vector<double> values) {
+            Stats stats = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+            if (values.empty()) {
+                return stats;
+            }
+            std::sort(values.begin(), values.end());
+            double sum = 0.0;
+            for (size_t i = 0; i < values.size(); ++i) {
+                sum += values[i];
+            }
+            stats.min = values.front();
+            stats.max = values.back();
+            stats.mean = sum / values.size();
+            stats.p50 = percentile(values, 50.0);
+            stats.p95 = percentile(values, 95.0);
+            stats.p99 = percentile(values, 99.0);
+            return stats;
+        }
+
+        // nearest rank on sorted values
+        static double percentile(const vector<double> &sorted, double p) {
+            size_t rank = (size_t) ceil(p / 100.0 * sorted.size());
+            rank = rank < 1 ? 1 : rank;
+            return sorted[std::min(rank, sorted.size()) - 1];
+        }
+
+        static string escape(const char *text) {
+            string result;
+            for (const char *c = text; c != NULL && *c != '\0'; ++c) {
+                if (*c == '"' || *c == '\\') {
+                    result += '\\';
+                }
+                result += *c;
+            }
+            return result;
+        }
+
+        static void writeStats(FILE *out, const char *name, const Stats &stats) {
+            fprintf(out, "\"%s\": { \"min\": %.4f, \"mean\": %.4f, \"p50\": %.4f, "
+                         "\"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f }",
+                    name, stats.min, stats.mean, stats.p50, stats.p95, stats.p99, stats.max);
+        }
+
+        bool writeReport(const Profiler &profiler, const BenchmarkOptions &options) {
+
+            FILE *out = stdout;
+            if (!options.output.empty()) {
+                out = fopen(options.output.c_str(), "w");
+                if (out == NULL) {
+                    fprintf(stderr, "Could not write %s\n", options.output.c_str());
+                    return false;
+                }
+            }
+
+            fprintf(out, "{\n");
+            fprintf(out, "  \"renderer\": \"%s\",\n", escape((const char *) glGetString(GL_RENDERER)).c_str());
+            fprintf(out, "  \"version\": \"%s\",\n", escape((const char *) glGetString(GL_VERSION)).c_str());
+            fprintf(out, "  \"width\": %d,\n  \"height\": %d,\n", options.width, options.height);
+            fprintf(out, "  \"quality\": \"%s\",\n", QUALITY_PRESETS[options.quality].name);
+            fprintf(out, "  \"timestep\": %.6f,\n  \"frames\": %d,\n", options.timestep, (int) frame_ms_.size());
+            fprintf(out, "  ");
+            writeStats(out, "frame_ms", computeStats(frame_ms_));
+            fprintf(out, ",\n  \"passes\": {\n");
+            for (int pass = 0; pass < profiler.PassCount(); ++pass) {
+                fprintf(out, "    \"%s\": { ", escape(profiler.PassName(pass).c_str()).c_str());
+                writeStats(out, "gpu_ms", computeStats(gpu_ms_[pass]));
+                fprintf(out, ", ");
+                writeStats(out, "cpu_ms", computeStats(cpu_ms_[pass]));
+                fprintf(out, " }%s\n", pass + 1 < profiler.PassCount() ? "," : "");
+            }
+            fprintf(out, "  }\n}\n");
+
+            if (out != stdout) {
+                fclose(out);
+                printf("Benchmark report written to %s\n", options.output.c_str());
+            }
+            return true;
+        }
+};
@@ -0,0 +1,57 @@
+#pragma once
+#include "icg_helper.h"
+
+// Scales a quality setting to keep a measured cost under a budget. The cost
+// is assumed to grow with the square of the scale (the triangles of a patch
+// with its tessellation level, the fragments with the render resolution),
+// so the scale follows sqrt(budget / cost) of the frame that was measured,
+// damped against the lag of the GPU queries.
+class BudgetGovernor {
+
+    public:
+        static const int LAG = 2;           // frames between a scale and its cost
+
+    private:
+        float scale_history_[LAG + 1];
+        int frame_ = 0;
+
+    public:
+        bool enabled = true;
+        float budget;
+        float min_scale;
+        float max_scale;
+
+        BudgetGovernor(float budget, float min_scale, float max_scale)
+            : budget(budget), min_scale(min_scale), max_scale(max_scale) {
+            std::fill(scale_history_, scale_history_ + LAG + 1, max_scale);
+        }
+
+        // takes the cost measured for the frame LAG frames ago (0 if unknown),
+        // returns the scale to use for the current frame
+        float Update(double cost) {
+
+            // slots hold the scales of the last LAG + 1 frames
+            float previous = scale_history_[(frame_ + LAG) % (LAG + 1)];
+            float measured_scale = scale_history_[(frame_ + 1) % (LAG + 1)];
+            float scale = previous;
+
+            if (!enabled) {
+                scale = max_scale;
+            } else if (cost > 0.95 * budget || (cost > 0.0 && cost < 0.7 * budget)) {
+                // costs are often quantized (integer tessellation levels), hold
+                // inside the dead band instead of oscillating between two scales
+                float target = measured_scale * sqrt(0.85 * budget / cost);
+                scale = previous + 0.5f * (target - previous);
+                scale = glm::clamp(scale, min_scale, max_scale);
+            }
+
+            scale_history_[frame_ % (LAG + 1)] = scale;
+            frame_++;
+            return scale;
+        }
+
+        // scale of the current frame
+        float Scale() const {
+            return scale_history_[(frame_ + LAG) % (LAG + 1)];
+        }
+};
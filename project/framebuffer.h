@@ -16,13 +16,13 @@ class FrameBuffer {
         void Bind() {
             //glGetIntegerv(GL_VIEWPORT, previous_viewport_);
             glViewport(0, 0, width_, height_);
-            glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_object_id_);
+            glstate::State().BindFramebuffer(GL_FRAMEBUFFER, framebuffer_object_id_);
             const GLenum buffers[] = { GL_COLOR_ATTACHMENT0 };
             glDrawBuffers(1 /*length of buffers[]*/, buffers);
         }
 
         void Unbind() {
-            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glstate::State().BindFramebuffer(GL_FRAMEBUFFER, 0);
             //glViewport(previous_viewport_[0], previous_viewport_[1], previous_viewport_[2], previous_viewport_[3]);
         }
 
@@ -32,14 +32,39 @@ class FrameBuffer {
 
         }
 
-        int Init(int image_width, int image_height, bool use_interpolation = false) {
+        int Width() const {
+            return width_;
+        }
+
+        int Height() const {
+            return height_;
+        }
+
+        GLuint ColorTexture() const {
+            return color_texture_id_;
+        }
+
+        // stretches the lower left src_width x src_height corner of the color
+        // attachment over the whole default framebuffer
+        void BlitToScreen(int src_width, int src_height, int screen_width, int screen_height) {
+            glstate::State().BindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer_object_id_);
+            glstate::State().BindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+            glBlitFramebuffer(0, 0, src_width, src_height, 0, 0, screen_width, screen_height,
+                              GL_COLOR_BUFFER_BIT,
+                              src_width == screen_width && src_height == screen_height ?
+                              GL_NEAREST : GL_LINEAR);
+        }
+
+        // the label names the target in the memory estimate
+        int Init(int image_width, int image_height, bool use_interpolation = false,
+                 GLint internal_format = GL_RGBA32F, const string &label = "Framebuffer") {
             this->width_ = image_width;
             this->height_ = image_height;
 
             // create color attachment
             {
                 glGenTextures(1, &color_texture_id_);
-                glBindTexture(GL_TEXTURE_2D, color_texture_id_);
+                glstate::State().BindTexture(0, GL_TEXTURE_2D, color_texture_id_);
                 glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
                 glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
@@ -56,8 +81,11 @@ class FrameBuffer {
                 // khronos.org/opengles/sdk/docs/man3/docbook4/xhtml/glTexImage2D.xml
                 //glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, width_, height_, 0,
 
-                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width_, height_, 0,
+                glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width_, height_, 0,
                              GL_RGB, GL_UNSIGNED_BYTE, NULL);
+                gpumemory::Registry().Track(GL_TEXTURE, color_texture_id_,
+                                            gpumemory::MEMORY_RENDER_TARGETS, label + " color",
+                                            gpumemory::TextureBytes(internal_format, width_, height_));
                 // how to load from buffer
             }
 
@@ -66,13 +94,16 @@ class FrameBuffer {
                 glGenRenderbuffers(1, &depth_render_buffer_id_);
                 glBindRenderbuffer(GL_RENDERBUFFER, depth_render_buffer_id_);
                 glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT32, width_, height_);
+                gpumemory::Registry().Track(GL_RENDERBUFFER, depth_render_buffer_id_,
+                                            gpumemory::MEMORY_RENDER_TARGETS, label + " depth",
+                                            gpumemory::TextureBytes(GL_DEPTH_COMPONENT32, width_, height_));
                 glBindRenderbuffer(GL_RENDERBUFFER, 0);
             }
 
             // tie it all together
             {
                 glGenFramebuffers(1, &framebuffer_object_id_);
-                glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_object_id_);
+                glstate::State().BindFramebuffer(GL_FRAMEBUFFER, framebuffer_object_id_);
                 glFramebufferTexture2D(GL_FRAMEBUFFER,
                                        GL_COLOR_ATTACHMENT0 /*location = 0*/,
                                        GL_TEXTURE_2D, color_texture_id_,
@@ -84,16 +115,17 @@ class FrameBuffer {
                     GL_FRAMEBUFFER_COMPLETE) {
                     cerr << "!!!ERROR: Framebuffer not OK :(" << endl;
                 }
-                glBindFramebuffer(GL_FRAMEBUFFER, 0); // avoid pollution
+                glstate::State().BindFramebuffer(GL_FRAMEBUFFER, 0); // avoid pollution
             }
 
             return color_texture_id_;
         }
 
         void Cleanup() {
-            glDeleteTextures(1, &color_texture_id_);
+            glstate::State().DeleteTextures(1, &color_texture_id_);
             glDeleteRenderbuffers(1, &depth_render_buffer_id_);
-            glBindFramebuffer(GL_FRAMEBUFFER, 0 /*UNBIND*/);
-            glDeleteFramebuffers(1, &framebuffer_object_id_);
+            gpumemory::Registry().Release(GL_RENDERBUFFER, depth_render_buffer_id_);
+            glstate::State().BindFramebuffer(GL_FRAMEBUFFER, 0 /*UNBIND*/);
+            glstate::State().DeleteFramebuffers(1, &framebuffer_object_id_);
         }
 };
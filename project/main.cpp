@@ -8,7 +8,14 @@
 
 #include <glm/gtc/matrix_transform.hpp>
 
+#include <chrono>
+#include <functional>
+#include <thread>
+
 #include "proceduralScene.h"
+#include "benchmark.h"
+#include "shaderbench.h"
+#include "offscreencontext.h"
 
 using namespace glm;
 
@@ -18,6 +25,18 @@ ProceduralScene scene;
 int window_width = WINDOW_WIDTH;
 int window_height = WINDOW_HEIGHT;
 
+// Chrome trace written at exit, empty when tracing from the start is off
+string trace_path;
+
+// camera paths: played instead of the prerecorded flight, recorded every frame
+string play_path;
+string record_path;
+
+// KHR_debug output, off unless asked for
+bool gl_debug = false;
+bool gl_debug_sync = false;
+GLenum gl_debug_severity = GL_DEBUG_SEVERITY_LOW;
+
 void errorCallback(int error, const char* description) {
     fprintf(stderr, "Error %d:", error);
     fputs(description, stderr);
@@ -27,7 +46,7 @@ void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
     scene.keyCallback(window, key, scancode, action, mods);
 }
 
-void framebufferSizeCallback(GLFWwindow* window, int width, int height) {
+void framebufferSizeCallback(GLFWwindow*, int width, int height) {
     window_width = width;
     window_height = height;
 
@@ -46,8 +65,272 @@ void cursorPositionCallback(GLFWwindow* window, double x, double y) {
     scene.cursorPositionCallback(window, x, y);
 }
 
+void scrollCallback(GLFWwindow* window, double x, double y) {
+    scene.scrollCallback(window, x, y);
+}
+
+void charCallback(GLFWwindow* window, unsigned int c) {
+    scene.charCallback(window, c);
+}
+
+// the window was uncovered, its content may be lost
+void windowRefreshCallback(GLFWwindow*) {
+    scene.RequestRedraw();
+}
+
+// sleeps until an event arrives or the timeout (seconds, < 0 for none) expires
+void waitEvents(double timeout) {
+    if (timeout < 0.0) {
+        glfwWaitEvents();
+        return;
+    }
+#if GLFW_VERSION_MAJOR > 3 || (GLFW_VERSION_MAJOR == 3 && GLFW_VERSION_MINOR >= 2)
+    glfwWaitEventsTimeout(timeout);
+#else
+    // no timed wait before GLFW 3.2, short sleeps keep the input responsive
+    std::this_thread::sleep_for(std::chrono::duration<double>(std::min(timeout, 0.01)));
+    glfwPollEvents();
+#endif
+}
+
+void printUsage(const char* program) {
+    printf("usage: %s [--benchmark] [--benchmark-out <file.json>] [--width <w>] [--height <h>]\n"
+           "          [--timestep <seconds>] [--frames <n>] [--warmup <n>] [--trace <file.json>]\n"
+           "          [--quality Low|Medium|High|Ultra] [--calibrate] [--idle]\n"
+           "          [--shader-bench] [--shader-sizes <n,n,...>] [--shader-draws <n>]\n"
+           "          [--play-path <file>] [--record-path <file>]\n"
+           "          [--gl-debug] [--gl-debug-sync] [--gl-debug-severity high|medium|low|notification]\n",
+           program);
+}
+
+void writeTrace() {
+    trace::Write(trace_path.c_str());
+}
+
+// initializes GLEW on the current context
+bool initGlew() {
+    glewExperimental = GL_TRUE;
+    GLenum status = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+    // an EGL context has no GLX display, the GL entry points are loaded anyway
+    if (status == GLEW_ERROR_NO_GLX_DISPLAY) {
+        status = GLEW_NO_ERROR;
+    }
+#endif
+    if (status != GLEW_NO_ERROR) {
+        fprintf(stderr, "Failed to initialize GLEW\n");
+        return false;
+    }
+    if (gl_debug) {
+        gldebug::Enable(gl_debug_severity, gl_debug_sync);
+    }
+    return true;
+}
+
+void printDebugSummary() {
+    if (gl_debug) {
+        printf("GL debug output: %d messages\n", gldebug::Messages());
+    }
+}
+
+// runs work on a context without showing anything on screen
+int runOffscreen(int width, int height, const char* title, std::function<int()> work) {
+
+    int status = EXIT_FAILURE;
+
+#ifdef HAVE_EGL
+    OffscreenContext context;
+    if (context.Create(width, height, gl_debug)) {
+        if (initGlew()) {
+            status = work();
+            printDebugSummary();
+        }
+        context.Destroy();
+        return status;
+    }
+    fprintf(stderr, "No EGL context, falling back to a hidden window\n");
+#endif
+
+    // hidden GLFW window, needs a display server
+    if(!glfwInit()) {
+        fprintf(stderr, "Failed to initialize GLFW\n");
+        return EXIT_FAILURE;
+    }
+    glfwSetErrorCallback(errorCallback);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+    glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, gl_debug ? GL_TRUE : GL_FALSE);
+    GLFWwindow* window = glfwCreateWindow(width, height, title, NULL, NULL);
+    if(window) {
+        glfwMakeContextCurrent(window);
+        glfwSwapInterval(0);
+        if (initGlew()) {
+            status = work();
+            printDebugSummary();
+        }
+        glfwDestroyWindow(window);
+    }
+    glfwTerminate();
+    return status;
+}
+
+// opens the camera paths of the command line once the scene is initialized
+bool loadCameraPaths() {
+    if (!play_path.empty() && !scene.LoadFlight(play_path.c_str())) {
+        return false;
+    }
+    if (!record_path.empty() && !scene.RecordFlight(record_path.c_str())) {
+        return false;
+    }
+    return true;
+}
+
+// renders the prerecorded flight without showing anything on screen
+int runBenchmark(const BenchmarkOptions& options) {
+    return runOffscreen(options.width, options.height, "Procedural Terrain Benchmark", [&]() {
+        scene.resizeCallback(options.width, options.height);
+        scene.Init(NULL);
+        scene.SetQualityLevel(options.quality);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        if (!loadCameraPaths()) {
+            scene.Cleanup();
+            return EXIT_FAILURE;
+        }
+        int status = Benchmark().Run(scene, options);
+        scene.Cleanup();
+        return status;
+    });
+}
+
+// times the terrain shaders one by one in offscreen targets
+int runShaderBenchmark(const ShaderBenchmarkOptions& options) {
+    // the targets are framebuffer objects, the default one is never drawn to
+    return runOffscreen(64, 64, "Procedural Terrain Shader Benchmark", [&]() {
+        return ShaderBenchmark().Run(options);
+    });
+}
+
+// comma separated sizes, false if one isn't positive
+bool parseSizes(const char* text, vector<int>& sizes) {
+    sizes.clear();
+    for (const char* c = text; *c != '\0'; ) {
+        int size = atoi(c);
+        if (size <= 0) {
+            return false;
+        }
+        sizes.push_back(size);
+        c = strchr(c, ',');
+        if (c == NULL) {
+            break;
+        }
+        c++;
+    }
+    return !sizes.empty();
+}
+
 int main(int argc, char *argv[]) {
 
+    // command line
+    bool benchmark = false;
+    BenchmarkOptions benchmark_options;
+    bool shader_benchmark = false;
+    ShaderBenchmarkOptions shader_options;
+    int quality = -1;               // cached or calibrated when not given
+    bool calibrate = false;
+    bool idle = false;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--benchmark") {
+            benchmark = true;
+        } else if (arg == "--benchmark-out" && has_value) {
+            benchmark = true;
+            benchmark_options.output = argv[++i];
+        } else if (arg == "--width" && has_value) {
+            benchmark_options.width = atoi(argv[++i]);
+        } else if (arg == "--height" && has_value) {
+            benchmark_options.height = atoi(argv[++i]);
+        } else if (arg == "--timestep" && has_value) {
+            benchmark_options.timestep = atof(argv[++i]);
+        } else if (arg == "--frames" && has_value) {
+            benchmark_options.max_frames = atoi(argv[++i]);
+        } else if (arg == "--warmup" && has_value) {
+            benchmark_options.warmup_frames = atoi(argv[++i]);
+        } else if (arg == "--shader-bench") {
+            shader_benchmark = true;
+        } else if (arg == "--shader-sizes" && has_value) {
+            shader_benchmark = true;
+            if (!parseSizes(argv[++i], shader_options.sizes)) {
+                printUsage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (arg == "--shader-draws" && has_value) {
+            shader_benchmark = true;
+            shader_options.draws = atoi(argv[++i]);
+        } else if (arg == "--play-path" && has_value) {
+            play_path = argv[++i];
+        } else if (arg == "--record-path" && has_value) {
+            record_path = argv[++i];
+        } else if (arg == "--trace" && has_value) {
+            trace_path = argv[++i];
+        } else if (arg == "--quality" && has_value) {
+            quality = QualityLevelFromName(argv[++i]);
+            if (quality < 0) {
+                printUsage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (arg == "--calibrate") {
+            calibrate = true;
+        } else if (arg == "--idle") {
+            idle = true;
+        } else if (arg == "--gl-debug") {
+            gl_debug = true;
+        } else if (arg == "--gl-debug-sync") {
+            gl_debug = gl_debug_sync = true;
+        } else if (arg == "--gl-debug-severity" && has_value) {
+            gl_debug = true;
+            gl_debug_severity = gldebug::SeverityFromName(argv[++i]);
+            if (gl_debug_severity == GL_NONE) {
+                printUsage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else {
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // records startup too, the trace is also written when exiting on an error
+    trace::SetThreadName("Main");
+    if (!trace_path.empty()) {
+        trace::Enable(true);
+        atexit(writeTrace);
+    }
+
+    if (shader_benchmark) {
+        if (shader_options.draws <= 0) {
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        shader_options.output = benchmark_options.output;
+        return runShaderBenchmark(shader_options);
+    }
+
+    if (benchmark) {
+        if (benchmark_options.width <= 0 || benchmark_options.height <= 0 ||
+            benchmark_options.timestep <= 0.0) {
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        if (quality >= 0) {
+            benchmark_options.quality = quality;
+        }
+        return runBenchmark(benchmark_options);
+    }
+
     // GLFW Initialization
     if(!glfwInit()) {
         fprintf(stderr, "Failed to initialize GLFW\n");
@@ -61,6 +344,7 @@ int main(int argc, char *argv[]) {
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, gl_debug ? GL_TRUE : GL_FALSE);
 
     // attempt to open the window: fails if required version unavailable
     GLFWwindow* window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT,
@@ -73,9 +357,7 @@ int main(int argc, char *argv[]) {
     // makes the OpenGL context of window current on the calling thread
     glfwMakeContextCurrent(window);
     // GLEW Initialization (must have a context)
-    glewExperimental = GL_TRUE;
-    if(glewInit() != GLEW_NO_ERROR) {
-        fprintf( stderr, "Failed to initialize GLEW\n");
+    if(!initGlew()) {
         glfwDestroyWindow(window);
         glfwTerminate();
         return EXIT_FAILURE;
@@ -84,12 +366,21 @@ int main(int argc, char *argv[]) {
 
     // initialize our OpenGL program
     scene.Init(window);
+    if (!loadCameraPaths()) {
+        scene.Cleanup();
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        return EXIT_FAILURE;
+    }
 
     // set callbacks
     glfwSetKeyCallback(window, keyCallback);
     glfwSetFramebufferSizeCallback(window, framebufferSizeCallback);
     glfwSetMouseButtonCallback(window, mouseButtonCallback);
     glfwSetCursorPosCallback(window, cursorPositionCallback);
+    glfwSetScrollCallback(window, scrollCallback);
+    glfwSetCharCallback(window, charCallback);
+    glfwSetWindowRefreshCallback(window, windowRefreshCallback);
 
     cout << "OpenGL" << glGetString(GL_VERSION) << endl;
 
@@ -97,29 +388,42 @@ int main(int argc, char *argv[]) {
     glfwGetFramebufferSize(window, &window_width, &window_height);
     scene.resizeCallback(window_width, window_height);
 
+    // quality preset for this machine, measured on the first launch
+    if (calibrate) {
+        scene.StartQualityCalibration();
+    } else {
+        scene.InitQuality(quality);
+    }
+
+    // only renders when the view changes, for installs left running unattended
+    scene.SetIdleMode(idle);
+
     // Set color to be rgba in order to allow transparency
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-    float lastTime = glfwGetTime();
-    int frameCount = 0;
-
-    // render loop
+    // render loop, frame times are shown in the profiler section of the gui
     while(!glfwWindowShouldClose(window)){
 
-        // Measure speedime
-        double currentTime = glfwGetTime();
-        frameCount = 1000/(currentTime-lastTime);
-        lastTime = currentTime;
-
-        //cout << frameCount << endl;
+        if (!scene.NeedsRedraw()) {
+            TRACE_SCOPE("Wait events");
+            waitEvents(scene.IdleTimeout());
+            continue;
+        }
 
         scene.Display();
-        glfwPollEvents();
-        glfwSwapBuffers(window);     
+        {
+            TRACE_SCOPE("Poll events");
+            glfwPollEvents();
+        }
+        {
+            TRACE_SCOPE("Swap buffers");
+            glfwSwapBuffers(window);
+        }
     }
 
     // Cleanup
     scene.Cleanup();
+    printDebugSummary();
 
     // close OpenGL window and terminate GLFW
     glfwDestroyWindow(window);
@@ -0,0 +1,124 @@
+#pragma once
+
+// Window-less OpenGL context for the benchmark mode, made current on the
+// calling thread. Uses EGL with a pbuffer surface, so it also runs on
+// machines without a GPU or display (e.g. Mesa llvmpipe on CI).
+// Only available when CMake found EGL (HAVE_EGL).
+
+#ifdef HAVE_EGL
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <cstdio>
+#include <cstring>
+
+class OffscreenContext {
+
+    private:
+        EGLDisplay display_ = EGL_NO_DISPLAY;
+        EGLSurface surface_ = EGL_NO_SURFACE;
+        EGLContext context_ = EGL_NO_CONTEXT;
+
+    public:
+        // a debug context reports more through KHR_debug, at some cost
+        bool Create(int width, int height, bool debug = false) {
+
+            display_ = getDisplay();
+            if (display_ == EGL_NO_DISPLAY || !eglInitialize(display_, NULL, NULL)) {
+                fprintf(stderr, "Failed to initialize EGL\n");
+                return false;
+            }
+
+            const EGLint config_attributes[] = {
+                EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+                EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+                EGL_RED_SIZE, 8,
+                EGL_GREEN_SIZE, 8,
+                EGL_BLUE_SIZE, 8,
+                EGL_ALPHA_SIZE, 8,
+                EGL_DEPTH_SIZE, 24,
+                EGL_NONE
+            };
+            EGLConfig config;
+            EGLint num_configs = 0;
+            if (!eglChooseConfig(display_, config_attributes, &config, 1, &num_configs) ||
+                num_configs == 0) {
+                fprintf(stderr, "No suitable EGL config\n");
+                Destroy();
+                return false;
+            }
+
+            const EGLint surface_attributes[] = {
+                EGL_WIDTH, width,
+                EGL_HEIGHT, height,
+                EGL_NONE
+            };
+            surface_ = eglCreatePbufferSurface(display_, config, surface_attributes);
+            if (surface_ == EGL_NO_SURFACE) {
+                fprintf(stderr, "Failed to create EGL pbuffer\n");
+                Destroy();
+                return false;
+            }
+
+            // the terrain needs tessellation shaders, hence 4.3 core
+            eglBindAPI(EGL_OPENGL_API);
+            const EGLint context_attributes[] = {
+                EGL_CONTEXT_MAJOR_VERSION_KHR, 4,
+                EGL_CONTEXT_MINOR_VERSION_KHR, 3,
+                EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+                EGL_CONTEXT_FLAGS_KHR, debug ? EGL_CONTEXT_OPENGL_DEBUG_BIT_KHR : 0,
+                EGL_NONE
+            };
+            context_ = eglCreateContext(display_, config, EGL_NO_CONTEXT, context_attributes);
+            if (context_ == EGL_NO_CONTEXT) {
+                fprintf(stderr, "Failed to create an OpenGL 4.3 core EGL context\n");
+                Destroy();
+                return false;
+            }
+
+            if (!eglMakeCurrent(display_, surface_, surface_, context_)) {
+                fprintf(stderr, "Failed to make the EGL context current\n");
+                Destroy();
+                return false;
+            }
+            return true;
+        }
+
+        void Destroy() {
+            if (display_ == EGL_NO_DISPLAY) {
+                return;
+            }
+            eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            if (context_ != EGL_NO_CONTEXT) {
+                eglDestroyContext(display_, context_);
+            }
+            if (surface_ != EGL_NO_SURFACE) {
+                eglDestroySurface(display_, surface_);
+            }
+            eglTerminate(display_);
+            display_ = EGL_NO_DISPLAY;
+            surface_ = EGL_NO_SURFACE;
+            context_ = EGL_NO_CONTEXT;
+        }
+
+    private:
+        // prefer the surfaceless platform, it needs neither X11 nor a GPU device
+        static EGLDisplay getDisplay() {
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+            const char *extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+            PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+                (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+            if (extensions != NULL && strstr(extensions, "EGL_MESA_platform_surfaceless") &&
+                getPlatformDisplay != NULL) {
+                EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+                                                        EGL_DEFAULT_DISPLAY, NULL);
+                if (display != EGL_NO_DISPLAY) {
+                    return display;
+                }
+            }
+#endif
+            return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        }
+};
+
+#endif
@@ -0,0 +1,149 @@
+#pragma once
+#include "icg_helper.h"
+#include "imgui/imgui.h"
+
+// ARB_pipeline_statistics_query, not in the bundled GLEW headers
+#ifndef GL_TESS_EVALUATION_SHADER_INVOCATIONS_ARB
+#define GL_TESS_EVALUATION_SHADER_INVOCATIONS_ARB 0x82F2
+#endif
+
+// Per pass primitive counts (GL_PRIMITIVES_GENERATED, after tessellation)
+// and tessellation evaluation shader invocations when the driver exposes
+// ARB_pipeline_statistics_query. Double buffered like the Profiler timers,
+// so the counts are two frames old but never stall.
+class PipelineStats {
+
+    private:
+        struct Pass {
+            string name;
+            GLuint primitive_queries[2];
+            GLuint invocation_queries[2];
+            bool issued[2];
+            GLuint64 primitives;
+            GLuint64 invocations;
+        };
+
+        vector<Pass> passes_;
+        int active_pass_ = -1;              // a query target can't be nested
+        int frame_ = 0;
+        bool invocation_queries_ = false;
+
+    public:
+        void Init() {
+            invocation_queries_ = icg_helper::HasExtension("GL_ARB_pipeline_statistics_query");
+        }
+
+        int AddPass(const string &name) {
+            Pass pass;
+            pass.name = name;
+            pass.issued[0] = pass.issued[1] = false;
+            pass.primitives = pass.invocations = 0;
+            glGenQueries(2, pass.primitive_queries);
+            if (invocation_queries_) {
+                glGenQueries(2, pass.invocation_queries);
+            }
+            passes_.push_back(pass);
+            return passes_.size() - 1;
+        }
+
+        // reads back the counts of two frames ago
+        void BeginFrame() {
+            int buffer = frame_ % 2;
+            for (size_t i = 0; i < passes_.size(); ++i) {
+                Pass &pass = passes_[i];
+                pass.primitives = pass.invocations = 0;
+                if (pass.issued[buffer]) {
+                    glGetQueryObjectui64v(pass.primitive_queries[buffer], GL_QUERY_RESULT,
+                                          &pass.primitives);
+                    if (invocation_queries_) {
+                        glGetQueryObjectui64v(pass.invocation_queries[buffer], GL_QUERY_RESULT,
+                                              &pass.invocations);
+                    }
+                    pass.issued[buffer] = false;
+                }
+            }
+        }
+
+        void EndFrame() {
+            frame_++;
+        }
+
+        void Begin(int id) {
+            Pass &pass = passes_[id];
+            int buffer = frame_ % 2;
+            if (active_pass_ >= 0 || pass.issued[buffer]) {
+                return;
+            }
+            glBeginQuery(GL_PRIMITIVES_GENERATED, pass.primitive_queries[buffer]);
+            if (invocation_queries_) {
+                glBeginQuery(GL_TESS_EVALUATION_SHADER_INVOCATIONS_ARB,
+                             pass.invocation_queries[buffer]);
+            }
+            active_pass_ = id;
+        }
+
+        void End(int id) {
+            if (active_pass_ != id) {
+                return;
+            }
+            glEndQuery(GL_PRIMITIVES_GENERATED);
+            if (invocation_queries_) {
+                glEndQuery(GL_TESS_EVALUATION_SHADER_INVOCATIONS_ARB);
+            }
+            passes_[id].issued[frame_ % 2] = true;
+            active_pass_ = -1;
+        }
+
+        GLuint64 Primitives(int id) const {
+            return passes_[id].primitives;
+        }
+
+        GLuint64 Invocations(int id) const {
+            return passes_[id].invocations;
+        }
+
+        void DrawGui() {
+            ImGui::Columns(3, "pipeline stats", false);
+            ImGui::Text("Pass"); ImGui::NextColumn();
+            ImGui::Text("Primitives"); ImGui::NextColumn();
+            ImGui::Text("TES invocations"); ImGui::NextColumn();
+            for (size_t i = 0; i < passes_.size(); ++i) {
+                ImGui::Text("%s", passes_[i].name.c_str()); ImGui::NextColumn();
+                ImGui::Text("%.2fM", passes_[i].primitives / 1e6); ImGui::NextColumn();
+                if (invocation_queries_) {
+                    ImGui::Text("%.2fM", passes_[i].invocations / 1e6);
+                } else {
+                    ImGui::Text("n/a");
+                }
+                ImGui::NextColumn();
+            }
+            ImGui::Columns(1);
+        }
+
+        void Cleanup() {
+            for (size_t i = 0; i < passes_.size(); ++i) {
+                glDeleteQueries(2, passes_[i].primitive_queries);
+                if (invocation_queries_) {
+                    glDeleteQueries(2, passes_[i].invocation_queries);
+                }
+            }
+            passes_.clear();
+        }
+};
+
+// Counts the primitives generated in the enclosing scope
+class PipelineStatsScope {
+
+    private:
+        PipelineStats &stats_;
+        int pass_;
+
+    public:
+        PipelineStatsScope(PipelineStats &stats, int pass) : stats_(stats), pass_(pass) {
+            stats_.Begin(pass_);
+        }
+
+        ~PipelineStatsScope() {
+            stats_.End(pass_);
+        }
+};
@@ -9,12 +9,22 @@
 
 #include "screenquad/screenquad.h"
 #include "framebuffer.h"
+#include "rendergraph.h"
+#include "tilecache/tilecache.h"
+#include "prefetcher.h"
+#include "projection.h"
+#include "textureloader.h"
+#include "profiler.h"
+#include "pipelinestats.h"
+#include "budgetgovernor.h"
+#include "qualitypresets.h"
 #include "terrain/terrain.h"
 #include "sky/sky.h"
 #include "water/water.h"
 #include "imgui/imgui.h"
 #include "imgui/imgui_impl_glfw_gl3.h"
-#include "bezier.h"
+#include "bezier_path.h"
+#include "camera_path.h"
 #include <glm/gtc/matrix_transform.hpp>
 
 using namespace glm;
@@ -26,6 +36,24 @@ class ProceduralScene {
         //Screen
         int window_width = WINDOW_WIDTH;
         int window_height = WINDOW_HEIGHT;
+        bool initialized = false;
+
+        // Dynamic resolution: the scene is rendered in the lower left
+        // render_width x render_height corner of window sized targets, then
+        // stretched over the window
+        int render_width = WINDOW_WIDTH;
+        int render_height = WINDOW_HEIGHT;
+        float target_frame_ms = 1000.0f / 60.0f;
+        BudgetGovernor resolution_governor = BudgetGovernor(target_frame_ms, 0.5f, 1.0f);
+        int mirror_width = WINDOW_WIDTH;        // reflection viewport
+        int mirror_height = WINDOW_HEIGHT;
+
+        // Quality presets
+        int quality_level = QUALITY_HIGH;
+        float reflection_scale = 1.0f;
+        QualityCalibration quality_calibration;
+        bool resolution_governor_enabled = true;    // restored after the calibration
+        bool tessellation_governor_enabled = true;
 
         //MVP
         mat4 model = IDENTITY_MATRIX;
@@ -33,13 +61,35 @@ class ProceduralScene {
         mat4 view = IDENTITY_MATRIX;
 
         //Objects
-        FrameBuffer framebuffer;
-        FrameBuffer mirror_framebuffer;
+        TextureLoader texture_loader;
+        FrameBuffer framebuffer;            // heightmap, kept across frames
+        TileCache tile_cache;               // noise tiles the heightmap is assembled from
+        TilePrefetcher prefetcher;          // where the camera goes next
+        RenderGraph render_graph;           // owns the per frame targets
         ScreenQuad screenquad;
         Terrain terrain;
         Sky sky;
         Water water;
 
+        // Profiling
+        Profiler profiler;
+        int pass_noise;
+        int pass_horizons;
+        int pass_reflection_sky;
+        int pass_reflection_terrain;
+        int pass_terrain;
+        int pass_water;
+        int pass_sky;
+        int pass_upscale;
+        int pass_gui;
+
+        // Primitive counts and the triangle budget of the terrain
+        PipelineStats pipeline_stats;
+        int stats_reflection_terrain;
+        int stats_terrain;
+        int stats_water;
+        BudgetGovernor tessellation_governor = BudgetGovernor(4e6f, 0.125f, 1.0f);
+
         // View and navigation
         GLfloat cam_yaw    = START_CAM_YAW;
         GLfloat cam_pitch  =  START_CAM_PITCH;
@@ -52,6 +102,23 @@ class ProceduralScene {
         Camera_mode camera_mode = CUSTOM;
         float last_frame_time = 0;
 
+        // Time
+        double scene_time = 0.0;
+        double fixed_timestep = 0.0;    // replaces the wall clock when > 0
+        int completed_paths = 0;        // camera paths played to the end
+
+        // Gui, disabled when rendering without a window
+        bool gui_enabled = false;
+
+        // Idle mode: a static view is only rendered again after an input or
+        // for the water animation, at a reduced rate
+        bool idle_mode = false;
+        float idle_water_fps = IDLE_WATER_FPS;     // 0 freezes the water
+        int redraw_frames = IDLE_REDRAW_FRAMES;    // still rendered before idling
+        double last_display_time = 0.0;            // wall clock
+        mat4 last_view = IDENTITY_MATRIX;
+        vec2 last_center = INITIAL_CENTER;
+
         float curr_camera_speed = CAM_SPEED;
         float pitch_speed = 0.0f;
         float yaw_speed = 0.0f;
@@ -66,7 +133,19 @@ class ProceduralScene {
         Bezier prerecorded_cam;
         bool start_path = true;
         float bezier_time;
-        float curr_speed = 0.5f;
+        float curr_speed = 0.5f;            // control points per second on average
+        BezierPath flight;                  // the path being flown, at constant speed
+        BezierPath flight_angles;
+        const Bezier *flight_source = NULL;
+        float flight_distance = 0.0f;
+
+        // Recorded flights: played instead of the prerecorded Bezier path
+        // when loaded, and the camera of every frame written when recording
+        CameraPath recorded_flight;
+        size_t recorded_cursor = 0;
+        double recorded_start = 0.0;
+        CameraPathWriter flight_writer;
+        double flight_writer_start = 0.0;
         vec3 eye = INITIAL_EYE;
         vec3 front = INITIAL_FRONT;
         vec3 up = INITIAL_UP;
@@ -80,6 +159,9 @@ class ProceduralScene {
         float H = INITIAL_H;
         float lacunarity = INITIAL_LACUNARITY;
         int octaves = INITIAL_OCTAVES;
+        bool noise_dirty = false;      // heightmap must be regenerated this frame
+        bool use_tile_cache = true;    // else the noise of the whole heightmap is rendered
+        bool terrain_shadows = true;
 
         // Water
         bool renderWater = true;
@@ -104,45 +186,120 @@ class ProceduralScene {
 
         void Init(GLFWwindow* window) {
 
+            TRACE_SCOPE("Scene init");
+
+            // start decoding textures in the background, the objects below
+            // only receive placeholders and get the images as they complete
+            texture_loader.Init();
+
             // set background color
             glClearColor(0.0, 0.0, 0.0, 1.0);
 
+            // one entry per render pass of Display()
+            profiler.Init();
+            pass_noise = profiler.AddPass("Noise");
+            pass_horizons = profiler.AddPass("Horizons");
+            pass_reflection_sky = profiler.AddPass("Reflection sky");
+            pass_reflection_terrain = profiler.AddPass("Reflection terrain");
+            pass_terrain = profiler.AddPass("Terrain");
+            pass_water = profiler.AddPass("Water");
+            pass_sky = profiler.AddPass("Sky");
+            pass_upscale = profiler.AddPass("Upscale");
+            pass_gui = profiler.AddPass("ImGui");
+
+            pipeline_stats.Init();
+            stats_reflection_terrain = pipeline_stats.AddPass("Reflection terrain");
+            stats_terrain = pipeline_stats.AddPass("Terrain");
+            stats_water = pipeline_stats.AddPass("Water");
+
             // Initialize gui
-            ImGui_ImplGlfwGL3_Init(window, true);
+            gui_enabled = window != NULL;
+            if (gui_enabled) {
+                ImGui_ImplGlfwGL3_Init(window, true);
+            }
 
             // enable depth test.
-            glEnable(GL_DEPTH_TEST);
-            glEnable(GL_MULTISAMPLE);
+            glstate::State().Enable(GL_DEPTH_TEST);
+            glstate::State().Enable(GL_MULTISAMPLE);
 
             // generate view matrix
             view = lookAt(eye, eye + front, up);
 
             // Initialize objects
-            sky.Init();
-            screenquad.Init(window_width, window_height);
-            heightmap = new GLfloat[1];
+            {
+                TRACE_SCOPE("Sky init");
+                sky.Init(texture_loader);
+            }
+            {
+                TRACE_SCOPE("Screenquad init");
+                screenquad.Init(window_width, window_height);
+            }
+            heightmap = new GLfloat[1]();
             prerecordedBezierInit();
 
-            GLuint framebuffer_tex_id = framebuffer.Init(window_width, window_height, true);
-            terrain.Init(framebuffer_tex_id);
-
-            GLuint mirror_framebuffer_tex_id = mirror_framebuffer.Init(window_width, window_height);
-            water.Init( mirror_framebuffer_tex_id);
+            const QualityPreset &preset = QUALITY_PRESETS[quality_level];
+            {
+                TRACE_SCOPE("Terrain init");
+                GLuint framebuffer_tex_id = framebuffer.Init(preset.heightmap_size,
+                                                             preset.heightmap_size, true,
+                                                             GL_RGBA32F, "Heightmap");
+                terrain.Init(framebuffer_tex_id, texture_loader);
+                tile_cache.Init();
+                tile_cache.Resize(preset.heightmap_size);
+            }
+            {
+                TRACE_SCOPE("Water init");
+                reflection_scale = preset.reflection_scale;
+                // the reflection texture is set from the render graph each frame
+                water.Init(0, texture_loader, preset.water_grid);
+            }
+            initialized = true;
+            SetQualityLevel(quality_level);
 
             renderNoiseToBuffer();
+            updateHorizons();
         }
 
 
         void Display() {
 
-            glViewport(0,0, window_width, window_height);
-            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            TRACE_SCOPE("Frame");
+            profiler.BeginFrame();
+            pipeline_stats.BeginFrame();
+
+            if (quality_calibration.IsRunning()) {
+                updateQualityCalibration();
+            }
+
+            // keep the terrain triangles of both views under the budget
+            GLuint64 terrain_primitives = pipeline_stats.Primitives(stats_reflection_terrain) +
+                                          pipeline_stats.Primitives(stats_terrain);
+            terrain.setTessellationScale(tessellation_governor.Update(terrain_primitives));
+            updateRenderSize();
+
+            last_display_time = glfwGetTime();
+            scene_time = fixed_timestep > 0.0 ? scene_time + fixed_timestep : last_display_time;
+            redraw_frames = std::max(redraw_frames - 1, 0);
+
+            // swap in the textures decoded since the last frame
+            {
+                TRACE_SCOPE("Texture updates");
+                texture_loader.Update();
+            }
 
-            // Update camera
+            // Update camera, a moving view keeps the frames coming
             cameraHandler();
+            if (flight_writer.IsOpen()) {
+                recordFlightSample();
+            }
+            if (view != last_view || center != last_center) {
+                last_view = view;
+                last_center = center;
+                RequestRedraw();
+            }
 
             // Setup Day/Night (and snow) cycle
-            const float time = glfwGetTime();
+            const float time = scene_time;
             float lightAngle;
             float snowHeight;
             if (auto_light) {
@@ -157,57 +314,229 @@ class ProceduralScene {
             vec3 mirror_eye = vec3(eye.x, -eye.y, eye.z);
             vec3 mirror_front = vec3(front.x, -front.y, front.z);
             mat4 view_reflection = lookAt(mirror_eye, mirror_eye + mirror_front, vec3(0.0f, -1.0f, 0.0f));
-            if(renderWater && !wireframe) {
-                // Render reflection to buffer
-                mirror_framebuffer.Bind();
-                {
-                    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-                    glEnable(GL_CLIP_DISTANCE0);
-                    if(reflectSky) {
-                        sky.Draw(model, view_reflection, projection, true, lightAngle);
-                    }
-                    if(reflectTerrain) {
-                        terrain.Draw(model, view_reflection, projection, 1, lightAngle, snowHeight);
-                    }
-                    glDisable(GL_CLIP_DISTANCE0);
+            // Passes in execution order, those that are disabled or whose
+            // output isn't used are culled and their targets never allocated
+            render_graph.Reset();
+            int heightmap_target = render_graph.ImportTarget("Heightmap", framebuffer);
+            int mirror_target = render_graph.CreateTarget("Reflection", mirrorTargetDesc());
+            int scene_target = render_graph.CreateTarget("Scene",
+                RenderTargetDesc{ std::max(window_width, 1), std::max(window_height, 1), GL_RGBA8, true });
+
+            // Regenerate the heightmap if the camera or the noise parameters changed
+            render_graph.AddPass("Noise", {}, heightmap_target, noise_dirty, [&]() {
+                renderNoiseToBuffer();
+                updateHorizons();
+            });
+
+            render_graph.AddPass("Reflection", { heightmap_target }, mirror_target,
+                                 renderWater && !wireframe, [&]() {
+                glViewport(0, 0, mirror_width, mirror_height);
+                glstate::State().Enable(GL_CLIP_DISTANCE0);
+                if(reflectSky) {
+                    ProfileScope scope(profiler, pass_reflection_sky);
+                    sky.Draw(model, view_reflection, projection, true, lightAngle);
                 }
-                mirror_framebuffer.Unbind();
-            }
+                if(reflectTerrain) {
+                    ProfileScope scope(profiler, pass_reflection_terrain);
+                    PipelineStatsScope stats_scope(pipeline_stats, stats_reflection_terrain);
+                    terrain.Draw(model, view_reflection, projection, 1, lightAngle, snowHeight);
+                }
+                glstate::State().Disable(GL_CLIP_DISTANCE0);
+            });
 
-            // Render scene
-            if (renderTerrain) {
+            render_graph.AddPass("Terrain", { heightmap_target }, scene_target, renderTerrain, [&]() {
+                ProfileScope scope(profiler, pass_terrain);
+                PipelineStatsScope stats_scope(pipeline_stats, stats_terrain);
+                glViewport(0, 0, render_width, render_height);
                 if(!wireframe) {
                     terrain.Draw(model, view, projection, 0, lightAngle, snowHeight);
                 } else {
-                    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+                    glstate::State().PolygonMode(GL_LINE);
                     terrain.Draw(model, view, projection, 0, lightAngle, snowHeight);
-                    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+                    glstate::State().PolygonMode(GL_FILL);
                 }
-            }
-            if (renderWater && !wireframe) {
+            });
+
+            render_graph.AddPass("Water", { mirror_target }, scene_target,
+                                 renderWater && !wireframe, [&]() {
+                ProfileScope scope(profiler, pass_water);
+                PipelineStatsScope stats_scope(pipeline_stats, stats_water);
+                glViewport(0, 0, render_width, render_height);
+                water.setMirrorTexture(render_graph.Target(mirror_target).ColorTexture());
                 water.Draw(time, model, view, projection, lightAngle);
-            }
-            if(!wireframe) {
+            });
+
+            render_graph.AddPass("Sky", {}, scene_target, !wireframe, [&]() {
+                ProfileScope scope(profiler, pass_sky);
+                glViewport(0, 0, render_width, render_height);
                 sky.Draw(model, view, projection, false, lightAngle);
-            }
+            });
+
+            // Stretch to the window, the interface stays at full resolution
+            render_graph.AddPass("Upscale", { scene_target }, render_graph.Backbuffer(), true, [&]() {
+                ProfileScope scope(profiler, pass_upscale);
+                render_graph.Target(scene_target).BlitToScreen(render_width, render_height,
+                                                               window_width, window_height);
+            });
 
             // Render interface
-            drawGui();
+            render_graph.AddPass("ImGui", {}, render_graph.Backbuffer(), gui_enabled, [&]() {
+                ProfileScope scope(profiler, pass_gui);
+                drawGui();
+            });
+
+            render_graph.Execute();
+
+            pipeline_stats.EndFrame();
+            profiler.EndFrame();
+            glstate::State().EndFrame();
         }
 
         void Cleanup() {
+            // what was still allocated at exit, and the peaks
+            gpumemory::Registry().Print(stdout);
+            profiler.Cleanup();
+            pipeline_stats.Cleanup();
+            texture_loader.Cleanup();
             framebuffer.Cleanup();
-            mirror_framebuffer.Cleanup();
+            tile_cache.Cleanup();
+            recorded_flight.Close();
+            if (flight_writer.IsOpen()) {
+                size_t samples = flight_writer.Count();
+                if (flight_writer.Finish()) {
+                    printf("Recorded %zu camera path samples\n", samples);
+                }
+            }
+            render_graph.Cleanup();
             screenquad.Cleanup();
             terrain.Cleanup();
             sky.Cleanup();
             water.Cleanup();
-            ImGui_ImplGlfwGL3_Shutdown();
+            if (gui_enabled) {
+                ImGui_ImplGlfwGL3_Shutdown();
+            }
+        }
+
+        // Advances the animations by a fixed step per frame instead of
+        // following the wall clock, for reproducible runs
+        void SetFixedTimestep(double timestep) {
+            fixed_timestep = timestep;
+        }
+
+        // the prerecorded flight follows the file instead of the Bezier path
+        bool LoadFlight(const char *path) {
+            if (!recorded_flight.Open(path)) {
+                fprintf(stderr, "Could not load the camera path %s\n", path);
+                return false;
+            }
+            printf("Camera path %s: %zu samples, %.1f s\n", path, recorded_flight.Count(),
+                   recorded_flight.Duration());
+            return true;
+        }
+
+        // writes the camera of every frame to the file until Cleanup
+        bool RecordFlight(const char *path) {
+            return flight_writer.Create(path);
+        }
+
+        // Starts the prerecorded flight from its first point
+        void StartPrerecordedPath() {
+            camera_mode = PRE_RECORDED;
+            start_path = true;
+            completed_paths = 0;
+        }
+
+        // recreates what the preset changes, Init uses the latest level
+        void SetQualityLevel(int level) {
+
+            const QualityPreset &preset = QUALITY_PRESETS[level];
+            quality_level = level;
+            if (!initialized) {
+                return;
+            }
+
+            if (preset.heightmap_size != framebuffer.Width()) {
+                framebuffer.Cleanup();
+                terrain.setHeightmapTexture(framebuffer.Init(preset.heightmap_size,
+                                                             preset.heightmap_size, true,
+                                                             GL_RGBA32F, "Heightmap"));
+                tile_cache.Resize(preset.heightmap_size);
+                noise_dirty = true;
+            }
+            reflection_scale = preset.reflection_scale;
+            setTerrainShadows(preset.terrain_shadows);
+            water.setGridResolution(preset.water_grid);
+            tessellation_governor.max_scale = preset.tessellation_scale;
+            tessellation_governor.budget = preset.triangle_budget;
+        }
+
+        // uses the forced level if any, else the level cached for this
+        // renderer, else measures the presets during the first frames
+        void InitQuality(int forced_level) {
+            int level = forced_level >= 0 ? forced_level : LoadQualityCache(QUALITY_CACHE_PATH);
+            if (level >= 0) {
+                SetQualityLevel(level);
+            } else {
+                StartQualityCalibration();
+            }
+        }
+
+        // the governors are paused so that the raw cost of each preset is measured
+        void StartQualityCalibration() {
+            cout << "Calibrating quality presets" << endl;
+            if (!quality_calibration.IsRunning()) {
+                resolution_governor_enabled = resolution_governor.enabled;
+                tessellation_governor_enabled = tessellation_governor.enabled;
+            }
+            resolution_governor.enabled = false;
+            tessellation_governor.enabled = false;
+            quality_calibration.Start(0.75f * target_frame_ms);
+            SetQualityLevel(quality_calibration.Level());
+        }
+
+        // renders every frame when disabled
+        void SetIdleMode(bool enabled) {
+            idle_mode = enabled;
+        }
+
+        // called on input and anything else that changes the image
+        void RequestRedraw() {
+            redraw_frames = IDLE_REDRAW_FRAMES;
+        }
+
+        // whether the next frame would differ from the last one
+        bool NeedsRedraw() {
+            return !idle_mode || redraw_frames > 0 || noise_dirty || auto_light ||
+                   quality_calibration.IsRunning() || !texture_loader.IsIdle() ||
+                   IdleTimeout() == 0.0;
+        }
+
+        // seconds until the water needs a new frame, -1 when nothing is animated
+        double IdleTimeout() {
+            if (!renderWater || wireframe || idle_water_fps <= 0.0f) {
+                return -1.0;
+            }
+            double remaining = last_display_time + 1.0 / idle_water_fps - glfwGetTime();
+            return std::max(remaining, 0.0);
+        }
+
+        // renders at the full window resolution when disabled
+        void SetDynamicResolution(bool enabled) {
+            resolution_governor.enabled = enabled;
+        }
+
+        int CompletedPaths() {
+            return completed_paths;
+        }
+
+        Profiler &GetProfiler() {
+            return profiler;
         }
 
         // callback methods
-        void mousePressCallback(GLFWwindow* window, int button, int action, int mod) {
+        void mousePressCallback(GLFWwindow*, int button, int action, int /*mod*/) {
+            RequestRedraw();
             if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS) {
                 drag = true;
             }
@@ -216,7 +545,9 @@ class ProceduralScene {
             }
         }
 
-        void cursorPositionCallback(GLFWwindow* window, double x, double y) {
+        void cursorPositionCallback(GLFWwindow*, double x, double y) {
+
+            RequestRedraw();
 
             if(drag && (camera_mode == CUSTOM || camera_mode == RECORD_BEZIER)){
 
@@ -245,7 +576,9 @@ class ProceduralScene {
             }
         }
 
-        void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+        void keyCallback(GLFWwindow* window, int key, int /*scancode*/, int action, int /*mods*/) {
+
+            RequestRedraw();
 
             if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS) {
                 glfwSetWindowShouldClose(window, GL_TRUE);
@@ -265,18 +598,30 @@ class ProceduralScene {
         }
 
 
+        // replace the ones installed by the gui, which only forward to it
+        void scrollCallback(GLFWwindow* window, double x, double y) {
+            RequestRedraw();
+            ImGui_ImplGlfwGL3_ScrollCallback(window, x, y);
+        }
+
+        void charCallback(GLFWwindow* window, unsigned int c) {
+            RequestRedraw();
+            ImGui_ImplGlfwGL3_CharCallback(window, c);
+        }
+
         // Gets called when the windows/framebuffer is resized.
         void resizeCallback(int width, int height) {
+            RequestRedraw();
             window_width = width;
             window_height = height;
 
             float near = CAM_NEAR;
             float far = CAM_FAR;
             float aspect = (float)window_width / window_height;
-            projection = computePerspectiveProjection(START_CAM_FOV, aspect, near, far);
+            projection = PerspectiveProjection(START_CAM_FOV, aspect, near, far);
 
-            //mirror_framebuffer.UpdateSize(width, height);
-            //framebuffer.UpdateSize(width, height);
+            // the render graph targets follow the window
+            render_graph.SetBackbufferSize(width, height);
         }
 
     // helper methods
@@ -284,6 +629,9 @@ class ProceduralScene {
 
         void cameraHandler() {
 
+            // the movements that can be predicted set it again
+            prefetcher.Clear();
+
             switch(camera_mode) {
                 case CUSTOM:
                     do_movement();
@@ -301,7 +649,11 @@ class ProceduralScene {
                     do_movement_bezier();
                     break;
                 case PRE_RECORDED:
-                    do_movement_bezier();
+                    if (recorded_flight.IsOpen()) {
+                        do_movement_recorded();
+                    } else {
+                        do_movement_bezier();
+                    }
                     break;
                 default:
                     break;
@@ -310,155 +662,147 @@ class ProceduralScene {
             view = lookAt(eye, eye + front, up);
         }
 
+        // Scales the render resolution so the passes that depend on it fit in
+        // what the others leave of the target frame time
+        void updateRenderSize() {
+
+            const int scaled_passes[] = { pass_reflection_sky, pass_reflection_terrain,
+                                          pass_terrain, pass_water, pass_sky };
+            float scaled_ms = 0.0f;
+            for (int pass : scaled_passes) {
+                scaled_ms += profiler.GpuTime(pass);
+            }
+            float fixed_ms = profiler.GpuFrameTime() - scaled_ms;
+            resolution_governor.budget = std::max(target_frame_ms - fixed_ms, 1.0f);
+
+            float scale = resolution_governor.Update(scaled_ms);
+            // minimized windows are 0x0
+            render_width = glm::clamp(int(window_width * scale + 0.5f), 1, std::max(window_width, 1));
+            render_height = glm::clamp(int(window_height * scale + 0.5f), 1, std::max(window_height, 1));
+            water.setViewportSize(render_width, render_height);
+
+            RenderTargetDesc mirror = mirrorTargetDesc();
+            mirror_width = glm::clamp(int(render_width * reflection_scale + 0.5f), 1, mirror.width);
+            mirror_height = glm::clamp(int(render_height * reflection_scale + 0.5f), 1, mirror.height);
+            water.setMirrorScale(vec2(mirror_width, mirror_height) / vec2(mirror.width, mirror.height));
+        }
+
+        // the reflection target has reflection_scale times the window size
+        RenderTargetDesc mirrorTargetDesc() {
+            return RenderTargetDesc{ std::max(1, int(window_width * reflection_scale + 0.5f)),
+                                     std::max(1, int(window_height * reflection_scale + 0.5f)),
+                                     GL_RGBA32F, reflection_scale < 1.0f };
+        }
+
+        void updateQualityCalibration() {
+
+            // GPU time when timer queries are available, the noise is included
+            // as if the camera was moving
+            float frame_ms = profiler.GpuFrameTime() > 0.0f ? profiler.GpuFrameTime()
+                                                            : profiler.FrameTime();
+            noise_dirty = true;
+
+            if (quality_calibration.Update(frame_ms)) {
+                SetQualityLevel(quality_calibration.Level());
+            }
+            if (!quality_calibration.IsRunning()) {
+                resolution_governor.enabled = resolution_governor_enabled;
+                tessellation_governor.enabled = tessellation_governor_enabled;
+                cout << "Selected quality " << QUALITY_PRESETS[quality_level].name << endl;
+                SaveQualityCache(QUALITY_CACHE_PATH, quality_level);
+            }
+        }
+
         void renderNoiseToBuffer() {
 
+            ProfileScope scope(profiler, pass_noise);
+            noise_dirty = false;
+
+            // assembled from cached tiles, only those entering the view are generated
+            if (use_tile_cache) {
+                tile_cache.Update(center, vec2(front.x, -front.z), prefetcher.Centers(),
+                                  screenquad, framebuffer);
+            }
+
             framebuffer.Bind();
             {
-                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-                screenquad.Draw();
+                if (!use_tile_cache) {
+                    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                    screenquad.Draw();
+                }
                 if (camera_mode == FPS) {
-                    glReadPixels(window_width/2, window_height/2, 1, 1, GL_RED, GL_FLOAT, heightmap);
+                    // synchronous, waits for the noise to be rendered
+                    TRACE_SCOPE("glReadPixels");
+                    glReadPixels(framebuffer.Width()/2, framebuffer.Height()/2, 1, 1,
+                                 GL_RED, GL_FLOAT, heightmap);
                 }
             }
             framebuffer.Unbind();
         }
 
+        // the shadows of the terrain follow the heightmap
+        void updateHorizons() {
+            ProfileScope scope(profiler, pass_horizons);
+            terrain.HeightmapChanged(framebuffer.Width());
+        }
+
+        // the horizons are not computed while the shadows are off
+        void setTerrainShadows(bool enabled) {
+            terrain_shadows = enabled;
+            terrain.setShadows(enabled);
+            if (enabled && !terrain.HorizonsValid() && terrain.ShadowsAvailable()) {
+                noise_dirty = true;
+            }
+        }
+
         void record(){
-            vec3* recordPoint = new vec3(center.x, eye.y, center.y);
-            path.addControlPoint(*recordPoint);
-            vec3* recordAngle = new vec3(cam_pitch, cam_yaw, 0);
-            cam.addControlPoint(*recordAngle);
+            vec3 recordPoint = vec3(center.x, eye.y, center.y);
+            path.addControlPoint(recordPoint);
+            vec3 recordAngle = vec3(cam_pitch, cam_yaw, 0);
+            cam.addControlPoint(recordAngle);
 
-            cout << "point " << recordPoint->x << " " << recordPoint->y << " " << recordPoint->z << endl;
-            cout << "angle " << recordAngle->x << " " << recordAngle->y << endl;
+            cout << "point " << recordPoint.x << " " << recordPoint.y << " " << recordPoint.z << endl;
+            cout << "angle " << recordAngle.x << " " << recordAngle.y << endl;
             cout << endl;
 
         }
 
         void prerecordedBezierInit() {
-            vec3* point;
-            vec3* angle;
-
-            point = new vec3(0.0, 20.0, 0.0);
-            prerecorded_path.addControlPoint(*point);
-            angle = new vec3(2.80488, 171.884, 0);
-            prerecorded_cam.addControlPoint(*angle);
-
-            point = new vec3(-0.0764674, 13.036, -0.0100195);
-            prerecorded_path.addControlPoint(*point);
-            angle = new vec3(-32.4414, 172.219, 0);
-            prerecorded_cam.addControlPoint(*angle);
-
-            point = new vec3(-0.0956858, 9.94455, -0.0126155);
-            prerecorded_path.addControlPoint(*point);
-            angle = new vec3(-32.0468, 172.617, 0);
-            prerecorded_cam.addControlPoint(*angle);
-
-            point = new vec3(-0.126162, 5.91191, -0.0183634);
-            prerecorded_path.addControlPoint(*point);
-            angle = new vec3(-24.6968, 167.017, 0);
-            prerecorded_cam.addControlPoint(*angle);
-
-            point = new vec3(-0.127933, 5.70301, -0.0187716);
-            prerecorded_path.addControlPoint(*point);
-            angle = new vec3(-24.6968, 167.017, 0);
-            prerecorded_cam.addControlPoint(*angle);
-
-            point = new vec3(-0.154594, 3.2237, -0.0322502);
-            prerecorded_path.addControlPoint(*point);
-            angle = new vec3(-12.9468, 122.517, 0);
-            prerecorded_cam.addControlPoint(*angle);
-
-            point = new vec3(-0.136699, 12.6406, 0.010991);
-            prerecorded_path.addControlPoint(*point);
-            angle = new vec3(-38.3061, 110.153, 0);
-            prerecorded_cam.addControlPoint(*angle);
-
-            point = new vec3(-0.127946, 15.6198, 0.0254738);
-            prerecorded_path.addControlPoint(*point);
-            angle = new vec3(-27.9061, 137.403, 0);
-            prerecorded_cam.addControlPoint(*angle);
-
-            point = new vec3(-0.127946, 15.6198, 0.0254738);
-            prerecorded_path.addControlPoint(*point);
-            angle = new vec3(-25.7561, 140.503, 0);
-            prerecorded_cam.addControlPoint(*angle);
-
-            point = new vec3(-0.119916, 16.8863, 0.0794416);
-            prerecorded_path.addControlPoint(*point);
-            angle = new vec3(4.22987, 197.66, 0);
-            prerecorded_cam.addControlPoint(*angle);
-
-            point = new vec3(-0.119916, 16.8863, 0.0794416);
-            prerecorded_path.addControlPoint(*point);
-            angle = new vec3(21.8504, 264.972, 0);
-            prerecorded_cam.addControlPoint(*angle);
-            //
-            point = new vec3(-0.120363, 26.4823, 0.137978);
-            prerecorded_path.addControlPoint(*point);
-            angle = new vec3(33.2766, 269.562, 0);
-            prerecorded_cam.addControlPoint(*angle);
-
-            point = new vec3(-0.120466, 28.677, 0.151354);
-            prerecorded_path.addControlPoint(*point);
-            angle = new vec3(33.2766, 269.562, 0);
-            prerecorded_cam.addControlPoint(*angle);
-
-            point = new vec3(-0.120188, 33.7663, 0.1969);
-            prerecorded_path.addControlPoint(*point);
-            angle = new vec3(21.2524, 269.546, 0);
-            prerecorded_cam.addControlPoint(*angle);
-
-            point = new vec3(-0.164935, 33.185, 0.300475);
-            prerecorded_path.addControlPoint(*point);
-            angle = new vec3(-24.9279, 201.296, 0);
-            prerecorded_cam.addControlPoint(*angle);
-
-            point = new vec3(-0.236531, 25.4521, 0.36964);
-            prerecorded_path.addControlPoint(*point);
-            angle = new vec3(-17.228, 173.596, 0);
-            prerecorded_cam.addControlPoint(*angle);
-            //
-            point = new vec3(-0.237592, 25.378, 0.370527);
-            prerecorded_path.addControlPoint(*point);
-            angle = new vec3(-17.228, 173.596, 0);
-            prerecorded_cam.addControlPoint(*angle);
-
-            point = new vec3(-0.316805, 13.5839, 0.349014);
-            prerecorded_path.addControlPoint(*point);
-            angle = new vec3(-30.0257, 150.34, 0);
-            prerecorded_cam.addControlPoint(*angle);
-
-            point = new vec3(-0.340688, 9.4208, 0.335942);
-            prerecorded_path.addControlPoint(*point);
-            angle = new vec3(-51.406, 155.128, 0);
-            prerecorded_cam.addControlPoint(*angle);
-
-            point = new vec3(-0.35186, 5.48069, 0.330763);
-            prerecorded_path.addControlPoint(*point);
-            angle = new vec3(-52.006, 155.128, 0);
-            prerecorded_cam.addControlPoint(*angle);
-
-            point = new vec3(-0.384819, 4.480028, 0.310678);
-            prerecorded_path.addControlPoint(*point);
-            angle = new vec3(5.0, 144.028, 0);
-            prerecorded_cam.addControlPoint(*angle);
-
-            point = new vec3(-0.387239, 4.418495, 0.308922);
-            prerecorded_path.addControlPoint(*point);
-            angle = new vec3(5.0, 144.028, 0);
-            prerecorded_cam.addControlPoint(*angle);
-
-            point = new vec3(-0.15, 60.0, 0.15);
-            prerecorded_path.addControlPoint(*point);
-            angle = new vec3(2.80488, 171.884, 0);
-            prerecorded_cam.addControlPoint(*angle);
-
-            point = new vec3(0.0, 20.0, 0.0);
-            prerecorded_path.addControlPoint(*point);
-            angle = new vec3(2.80488, 171.884, 0);
-            prerecorded_cam.addControlPoint(*angle);
 
+            // position, then pitch and yaw of every control point
+            static const float CONTROL_POINTS[][5] = {
+                { 0.0,        20.0,     0.0,        2.80488,  171.884 },
+                { -0.0764674, 13.036,   -0.0100195, -32.4414, 172.219 },
+                { -0.0956858, 9.94455,  -0.0126155, -32.0468, 172.617 },
+                { -0.126162,  5.91191,  -0.0183634, -24.6968, 167.017 },
+                { -0.127933,  5.70301,  -0.0187716, -24.6968, 167.017 },
+                { -0.154594,  3.2237,   -0.0322502, -12.9468, 122.517 },
+                { -0.136699,  12.6406,  0.010991,   -38.3061, 110.153 },
+                { -0.127946,  15.6198,  0.0254738,  -27.9061, 137.403 },
+                { -0.127946,  15.6198,  0.0254738,  -25.7561, 140.503 },
+                { -0.119916,  16.8863,  0.0794416,  4.22987,  197.66 },
+                { -0.119916,  16.8863,  0.0794416,  21.8504,  264.972 },
+                { -0.120363,  26.4823,  0.137978,   33.2766,  269.562 },
+                { -0.120466,  28.677,   0.151354,   33.2766,  269.562 },
+                { -0.120188,  33.7663,  0.1969,     21.2524,  269.546 },
+                { -0.164935,  33.185,   0.300475,   -24.9279, 201.296 },
+                { -0.236531,  25.4521,  0.36964,    -17.228,  173.596 },
+                { -0.237592,  25.378,   0.370527,   -17.228,  173.596 },
+                { -0.316805,  13.5839,  0.349014,   -30.0257, 150.34 },
+                { -0.340688,  9.4208,   0.335942,   -51.406,  155.128 },
+                { -0.35186,   5.48069,  0.330763,   -52.006,  155.128 },
+                { -0.384819,  4.480028, 0.310678,   5.0,      144.028 },
+                { -0.387239,  4.418495, 0.308922,   5.0,      144.028 },
+                { -0.15,      60.0,     0.15,       2.80488,  171.884 },
+                { 0.0,        20.0,     0.0,        2.80488,  171.884 },
+            };
+            for (size_t i = 0; i < sizeof(CONTROL_POINTS) / sizeof(CONTROL_POINTS[0]); ++i) {
+                const float *control = CONTROL_POINTS[i];
+                vec3 point = vec3(control[0], control[1], control[2]);
+                prerecorded_path.addControlPoint(point);
+                vec3 angle = vec3(control[3], control[4], 0.0f);
+                prerecorded_cam.addControlPoint(angle);
+            }
         }
 
         void do_movement_bezier(){
@@ -474,60 +818,105 @@ class ProceduralScene {
                 curr_speed = curr_speed < 0.0 ? 0.0 : curr_speed;
             }
 
+            // rebuilt when the mode changes or a point was recorded
+            Bezier &points = camera_mode == PRE_RECORDED ? prerecorded_path : path;
+            Bezier &angles = camera_mode == PRE_RECORDED ? prerecorded_cam : cam;
+            if (flight_source != &points || flight.Count() != points.getCount()) {
+                flight.Build(points);
+                flight_angles.Build(angles, 0);
+                flight_source = &points;
+            }
+            float speed = flight.End() > 0.0f ? curr_speed * flight.Length() / flight.End() : 0.0f;
+
             if (start_path) {
 
                 bezier_time = 0;
+                flight_distance = 0.0f;
+                last_frame_time = scene_time;
                 start_path = false;
             } else {
 
 
-                // Update Bezier parameter
-                float curr_time = glfwGetTime();
+                // Update the distance flown
+                float curr_time = scene_time;
                 float frame_time = curr_time - last_frame_time;
                 last_frame_time = curr_time;
-                bezier_time += frame_time*curr_speed;
-
-                if(camera_mode == PRE_RECORDED) {
-                    if (bezier_time > prerecorded_path.getCount() - 1) {
+                flight_distance += frame_time*speed;
 
-                        // (Re)Start
-                        start_path = true;
-                        center = vec2(0.0, 0.0);
-                    } else {
+                if (flight.Length() <= 0.0f || flight_distance > flight.Length()) {
 
-                        // Update position
-                        vec3 currPoint = prerecorded_path.getBezier(bezier_time);
-                        eye.y = currPoint.y;
-                        center = vec2(currPoint.x, currPoint.z);
-                        vec3 currAngles = prerecorded_cam.getBezier(bezier_time);
-                        cam_pitch = currAngles.x;
-                        cam_yaw = currAngles.y;
-                        updateFront();
-                    }
+                    // (Re)Start
+                    start_path = true;
+                    completed_paths++;
+                    center = vec2(0.0, 0.0);
                 } else {
-                    if (bezier_time > path.getCount() - 1) {
-
-                        // (Re)Start
-                        start_path = true;
-                        center = vec2(0.0, 0.0);
-                    } else {
 
-                        // Update position
-                        vec3 currPoint = path.getBezier(bezier_time);
-                        eye.y = currPoint.y;
-                        center = vec2(currPoint.x, currPoint.z);
-                        vec3 currAngles = cam.getBezier(bezier_time);
-                        cam_pitch = currAngles.x;
-                        cam_yaw = currAngles.y;
-                        updateFront();
-                    }
+                    // Update position
+                    bezier_time = flight.ParameterAt(flight_distance);
+                    vec3 currPoint = flight.Evaluate(bezier_time);
+                    eye.y = currPoint.y;
+                    center = vec2(currPoint.x, currPoint.z);
+                    vec3 currAngles = flight_angles.Evaluate(bezier_time);
+                    cam_pitch = currAngles.x;
+                    cam_yaw = currAngles.y;
+                    updateFront();
                 }
             }
 
+            if (!start_path) {
+                prefetcher.LookAhead(flight, flight_distance, speed);
+            }
+
             // Render
             screenquad.setCenter(center);
             terrain.setCenter(center);
-            renderNoiseToBuffer();
+            noise_dirty = true;
+        }
+
+        // follows the recorded flight in scene time
+        void do_movement_recorded() {
+
+            if (start_path) {
+                recorded_start = scene_time;
+                recorded_cursor = 0;
+                start_path = false;
+            }
+
+            float time = scene_time - recorded_start;
+            if (time > recorded_flight.Duration()) {
+
+                // (Re)Start
+                start_path = true;
+                completed_paths++;
+                center = vec2(0.0, 0.0);
+            } else {
+
+                // Update position
+                CameraPathSample sample = recorded_flight.Interpolate(time, recorded_cursor);
+                eye.y = sample.y;
+                center = vec2(sample.x, sample.z);
+                cam_pitch = sample.pitch;
+                cam_yaw = sample.yaw;
+                updateFront();
+                prefetcher.LookAhead(recorded_flight, time, recorded_cursor);
+            }
+
+            // Render
+            screenquad.setCenter(center);
+            terrain.setCenter(center);
+            noise_dirty = true;
+        }
+
+        void recordFlightSample() {
+            if (flight_writer.Count() == 0) {
+                flight_writer_start = scene_time;
+            }
+            CameraPathSample sample = { (float) (scene_time - flight_writer_start), center.x, eye.y,
+                                        center.y, cam_pitch, cam_yaw };
+            if (!flight_writer.Append(sample)) {
+                fprintf(stderr, "Could not record the camera path, recording stopped\n");
+                flight_writer.Finish();
+            }
         }
 
         void do_movement_fps(){
@@ -616,9 +1005,11 @@ class ProceduralScene {
 
             // Render new noise texture if needed
             if (needRender) {
+                prefetcher.Extrapolate(center, cam_yaw, cam_pitch, curr_camera_speed, yaw_speed,
+                                       keys[GLFW_KEY_A] || keys[GLFW_KEY_D]);
                 screenquad.setCenter(center);
                 terrain.setCenter(center);
-                renderNoiseToBuffer();
+                noise_dirty = true;
             }
         }
 
@@ -664,7 +1055,7 @@ class ProceduralScene {
                 screenquad.setCenter(center);
                 terrain.setCenter(center);
                 water.setCenter(center);
-                renderNoiseToBuffer();
+                noise_dirty = true;
             }
         }
 
@@ -677,26 +1068,6 @@ class ProceduralScene {
             front = glm::normalize(frontValue);
         }
 
-        mat4 computePerspectiveProjection(float fovy, float aspect, float near, float far) {
-
-            mat4 proj = IDENTITY_MATRIX;
-
-            float top = near*tan(radians(fovy));
-            float bottom = -top;
-            float right = top*aspect;
-            float left = -right;
-
-            proj[0][0] = 2.0f*near / (right - left);
-            proj[1][1] = 2.0f*near / (top - bottom);
-            proj[2][2] = -(far+near) / (far - near);
-            proj[2][3] = -1.0f;
-            proj[2][0] = (right + left) / (right - left);
-            proj[2][1] = (top + bottom) / (top - bottom);
-            proj[3][2] = -2.0f*far*near / (far - near);
-
-            return proj;
-        }
-
 //************* INTERFACE *************************************************************
 
         void drawGui() {
@@ -710,6 +1081,7 @@ class ProceduralScene {
             drawTerrainMenu();
             drawWaterMenu();
             drawLightMenu();
+            drawProfilerMenu();
 
             ImGui::End();
             ImGui::Render();
@@ -728,26 +1100,54 @@ class ProceduralScene {
             if(ImGui::Checkbox("Wireframe", &wireframe)) {
                 terrain.setWireframe(wireframe);
             }
+            if (ImGui::Checkbox("Tile cache", &use_tile_cache)) {
+                noise_dirty = true;
+            }
+            if (use_tile_cache) {
+                const TileScheduler &scheduler = tile_cache.Scheduler();
+                ImGui::Text("Tiles %d/%d resident, %d generated, %d streamed",
+                            tile_cache.ResidentTiles(), TILE_CACHE_PAGES,
+                            tile_cache.TotalGeneratedTiles(), tile_cache.TotalStreamedTiles());
+                ImGui::Text("Workers %d: %d pending, %d running, %d cancelled",
+                            scheduler.Workers(), scheduler.Pending(), scheduler.Running(),
+                            scheduler.Cancelled());
+                if (tile_cache.UsesStore()) {
+                    ImGui::Text("Tile store: %d loaded", tile_cache.TotalLoadedTiles());
+                }
+            }
+            bool shadows = terrain_shadows;
+            if(terrain.ShadowsAvailable() && ImGui::Checkbox("Shadows", &shadows)) {
+                setTerrainShadows(shadows);
+            }
 
             ImGui::Spacing();
             ImGui::Spacing();
 
             if (ImGui::SliderInt("Scale", &scaleFactor, 0, 20)) {
                 screenquad.setScaleFactor(scaleFactor);
-                renderNoiseToBuffer();
+                noise_dirty = true;
             }
             if (ImGui::SliderFloat("H", &H, 0.0, 3.0, "%.2f")) {
                 screenquad.setH(H);
-                renderNoiseToBuffer();
+                noise_dirty = true;
             }
             if (ImGui::SliderFloat("Lacunarity", &lacunarity, 2.0, 5.0, "%.2f")) {
                 screenquad.setLacunarity(lacunarity);
-                renderNoiseToBuffer();
+                noise_dirty = true;
             }
             if (ImGui::SliderInt("Octaves", &octaves, 1, 16)) {
                 screenquad.setOctaves(octaves);
-                renderNoiseToBuffer();
+                noise_dirty = true;
+            }
+
+            ImGui::Spacing();
+            ImGui::Text("Tessellation");
+            ImGui::Checkbox("Triangle budget", &tessellation_governor.enabled);
+            float budget_millions = tessellation_governor.budget / 1e6f;
+            if (ImGui::SliderFloat("Budget (M tris)", &budget_millions, 0.5, 16.0, "%.1f")) {
+                tessellation_governor.budget = budget_millions * 1e6f;
             }
+            ImGui::Text("Level scale %.2f", tessellation_governor.Scale());
         }
 
         void drawWaterMenu() {
@@ -815,6 +1215,90 @@ class ProceduralScene {
             }
         }
 
+        void drawProfilerMenu() {
+
+            ImGui::Spacing();
+            ImGui::Spacing();
+            ImGui::Spacing();
+            ImGui::Spacing();
+            ImGui::Text("PROFILER");
+            ImGui::Spacing();
+
+            profiler.DrawGui();
+            pipeline_stats.DrawGui();
+
+            const char *quality_names[QUALITY_LEVELS];
+            for (int level = 0; level < QUALITY_LEVELS; ++level) {
+                quality_names[level] = QUALITY_PRESETS[level].name;
+            }
+            int level = quality_level;
+            if (ImGui::Combo("Quality", &level, quality_names, QUALITY_LEVELS) &&
+                !quality_calibration.IsRunning()) {
+                SetQualityLevel(level);
+                SaveQualityCache(QUALITY_CACHE_PATH, level);
+            }
+            ImGui::SameLine();
+            if (quality_calibration.IsRunning()) {
+                ImGui::Text("Calibrating...");
+            } else if (ImGui::Button("Calibrate")) {
+                StartQualityCalibration();
+            }
+
+            ImGui::Checkbox("Idle when static", &idle_mode);
+            if (idle_mode) {
+                ImGui::SliderFloat("Idle water fps", &idle_water_fps, 0.0, 30.0, "%.0f");
+            }
+
+            ImGui::Checkbox("Dynamic resolution", &resolution_governor.enabled);
+            ImGui::SliderFloat("Target ms", &target_frame_ms, 4.0, 50.0, "%.1f");
+            ImGui::Text("Rendering %dx%d (%.0f%%)", render_width, render_height,
+                        100.0f * resolution_governor.Scale());
+            ImGui::Text("Render targets %d (%.1f MB), %d passes culled",
+                        render_graph.PooledTargets(), render_graph.PooledBytes() / 1e6,
+                        render_graph.CulledPasses());
+
+            drawMemoryGui();
+
+            // Chrome trace of everything recorded since tracing was enabled
+            bool tracing = trace::IsEnabled();
+            if (ImGui::Checkbox("Record trace", &tracing)) {
+                trace::Enable(tracing);
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Save trace")) {
+                trace::Write("trace.json");
+            }
+        }
+
+        // estimated GPU memory, per category and per allocation
+        void drawMemoryGui() {
+            gpumemory::MemoryRegistry &memory = gpumemory::Registry();
+            if (!ImGui::TreeNode("GPU memory", "GPU memory %.1f MB", memory.TotalBytes() / 1e6)) {
+                return;
+            }
+            ImGui::Columns(3, "memory", false);
+            ImGui::Text("category"); ImGui::NextColumn();
+            ImGui::Text("MB"); ImGui::NextColumn();
+            ImGui::Text("peak MB"); ImGui::NextColumn();
+            ImGui::Separator();
+            for (int category = 0; category < gpumemory::MEMORY_CATEGORIES; ++category) {
+                ImGui::Text("%s", gpumemory::CATEGORY_NAMES[category]); ImGui::NextColumn();
+                ImGui::Text("%.2f", memory.Bytes(category) / 1e6); ImGui::NextColumn();
+                ImGui::Text("%.2f", memory.PeakBytes(category) / 1e6); ImGui::NextColumn();
+            }
+            ImGui::Columns(1);
+
+            if (ImGui::TreeNode("Allocations")) {
+                vector<gpumemory::Allocation> allocations = memory.Allocations();
+                for (size_t i = 0; i < allocations.size(); ++i) {
+                    ImGui::Text("%8.2f MB  %s", allocations[i].bytes / 1e6,
+                                allocations[i].label.c_str());
+                }
+                ImGui::TreePop();
+            }
+            ImGui::TreePop();
+        }
+
         void drawCameraMenu() {
 
             ImGui::Spacing();
@@ -824,7 +1308,9 @@ class ProceduralScene {
             ImGui::Text("CAMERA");
             ImGui::Spacing();
 
-            static int new_camera_mode = 4;
+            // the radio values are those of Camera_mode, the mode only changes
+            // on a click, not on every frame the menu is drawn
+            int new_camera_mode = camera_mode;
             ImGui::RadioButton("Fly-through", &new_camera_mode, 0); ImGui::SameLine();
             ImGui::RadioButton("FPS", &new_camera_mode, 1); ImGui::SameLine();
             ImGui::RadioButton("RecordBezier", &new_camera_mode, 2); ImGui::SameLine();
@@ -832,14 +1318,19 @@ class ProceduralScene {
             ImGui::RadioButton("Prerecorded Bezier", &new_camera_mode, 5); ImGui::SameLine();
             ImGui::RadioButton("Custom", &new_camera_mode, 4);
 
+            if (new_camera_mode == camera_mode) {
+                return;
+            }
+
             switch (new_camera_mode) {
             case 0:
                 camera_mode = FLYTHROUGH;
                 break;
             case 1:
                 camera_mode = FPS;
+                // reads back the height under the camera, only done in FPS mode
                 renderNoiseToBuffer();
-                eye.y = heightmap[0]*20+4;
+                eye.y = heightmap[0]*TERRAIN_HEIGHT_MULTIPLIER+4;
                 break;
             case 2:
                 camera_mode = RECORD_BEZIER;
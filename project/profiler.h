@@ -0,0 +1,285 @@
+#pragma once
+#include "icg_helper.h"
+#include "imgui/imgui.h"
+
+#include <chrono>
+
+// Per pass GPU (GL_TIME_ELAPSED) and CPU timings with a rolling history.
+//
+// Queries are double buffered: the queries issued in frame N are read back
+// at the start of frame N+2, when they are long finished, so reading them
+// never stalls the pipeline.
+class Profiler {
+
+    public:
+        static const int HISTORY_SIZE = 240;
+        static const int GPU_LATENCY = 2;   // frames before the queries are read back
+
+    private:
+        typedef std::chrono::steady_clock Clock;
+
+        struct Pass {
+            string name;
+            GLuint queries[2];
+            bool issued[2];
+            bool recorded;                  // already timed in this frame
+            Clock::time_point cpu_start;
+            float cpu_ms;                   // accumulated over the current frame
+            float gpu_history[HISTORY_SIZE];
+            float cpu_history[HISTORY_SIZE];
+        };
+
+        vector<Pass> passes_;
+        int active_pass_ = -1;              // GL_TIME_ELAPSED queries can't nest
+        bool timer_queries_ = false;
+
+        int frame_ = 0;                     // frames since Init
+        int history_index_ = 0;             // slot written by the current frame
+        float frame_history_[HISTORY_SIZE];
+        Clock::time_point frame_start_;
+        bool show_graphs_ = true;
+
+    public:
+        void Init() {
+            timer_queries_ = GLEW_VERSION_3_3 || icg_helper::HasExtension("GL_ARB_timer_query");
+            if (!timer_queries_) {
+                cout << "Timer queries not supported, only CPU times will be profiled" << endl;
+            }
+            std::fill(frame_history_, frame_history_ + HISTORY_SIZE, 0.0f);
+            frame_start_ = Clock::now();
+        }
+
+        // returns the pass id to use with Begin/End
+        int AddPass(const string &name) {
+            Pass pass;
+            pass.name = name;
+            pass.issued[0] = pass.issued[1] = false;
+            pass.recorded = false;
+            pass.cpu_ms = 0.0f;
+            std::fill(pass.gpu_history, pass.gpu_history + HISTORY_SIZE, 0.0f);
+            std::fill(pass.cpu_history, pass.cpu_history + HISTORY_SIZE, 0.0f);
+            if (timer_queries_) {
+                glGenQueries(2, pass.queries);
+            }
+            passes_.push_back(pass);
+            return passes_.size() - 1;
+        }
+
+        void BeginFrame() {
+
+            Clock::time_point now = Clock::now();
+            history_index_ = frame_ % HISTORY_SIZE;
+            frame_history_[history_index_] = elapsedMs(frame_start_, now);
+            frame_start_ = now;
+
+            // collect the queries issued two frames ago into this frame's slot
+            int buffer = frame_ % 2;
+            for (size_t i = 0; i < passes_.size(); ++i) {
+                Pass &pass = passes_[i];
+                pass.gpu_history[history_index_] = 0.0f;
+                if (pass.issued[buffer]) {
+                    GLuint64 elapsed = 0;
+                    glGetQueryObjectui64v(pass.queries[buffer], GL_QUERY_RESULT, &elapsed);
+                    pass.gpu_history[history_index_] = elapsed / 1e6f;
+                    pass.issued[buffer] = false;
+                }
+                pass.cpu_ms = 0.0f;
+                pass.recorded = false;
+            }
+        }
+
+        void EndFrame() {
+            for (size_t i = 0; i < passes_.size(); ++i) {
+                passes_[i].cpu_history[history_index_] = passes_[i].cpu_ms;
+            }
+            frame_++;
+        }
+
+        void Begin(int id) {
+            Pass &pass = passes_[id];
+            pass.cpu_start = Clock::now();
+
+            // only the first occurrence per frame and no nesting on the GPU side
+            if (timer_queries_ && !pass.recorded && active_pass_ < 0) {
+                glBeginQuery(GL_TIME_ELAPSED, pass.queries[frame_ % 2]);
+                active_pass_ = id;
+            }
+        }
+
+        void End(int id) {
+            Pass &pass = passes_[id];
+            pass.cpu_ms += elapsedMs(pass.cpu_start, Clock::now());
+
+            if (active_pass_ == id) {
+                glEndQuery(GL_TIME_ELAPSED);
+                pass.issued[frame_ % 2] = true;
+                pass.recorded = true;
+                active_pass_ = -1;
+            }
+        }
+
+        // latest GPU time of a pass, in ms
+        float GpuTime(int id) const {
+            return passes_[id].gpu_history[history_index_];
+        }
+
+        // CPU time of a pass in the current frame, valid after its End()
+        float CpuTime(int id) const {
+            return passes_[id].cpu_ms;
+        }
+
+        // sum of the latest GPU times of all passes, in ms
+        float GpuFrameTime() const {
+            float total = 0.0f;
+            for (size_t i = 0; i < passes_.size(); ++i) {
+                total += passes_[i].gpu_history[history_index_];
+            }
+            return total;
+        }
+
+        float FrameTime() const {
+            return frame_history_[history_index_];
+        }
+
+        int PassCount() const {
+            return passes_.size();
+        }
+
+        const string &PassName(int id) const {
+            return passes_[id].name;
+        }
+
+        void DrawGui() {
+
+            float frame_ms = average(frame_history_);
+            ImGui::Text("Frame %.2f ms (%.0f fps), GPU %.2f ms", frame_ms,
+                        frame_ms > 0.0f ? 1000.0f / frame_ms : 0.0f, averageGpuFrameTime());
+            ImGui::Checkbox("Graphs", &show_graphs_);
+            ImGui::SameLine();
+            if (ImGui::Button("Export CSV")) {
+                ExportCsv("profile.csv");
+            }
+
+            ImGui::Columns(3, "profiler", false);
+            ImGui::Text("Pass"); ImGui::NextColumn();
+            ImGui::Text("GPU ms"); ImGui::NextColumn();
+            ImGui::Text("CPU ms"); ImGui::NextColumn();
+            for (size_t i = 0; i < passes_.size(); ++i) {
+                ImGui::Text("%s", passes_[i].name.c_str()); ImGui::NextColumn();
+                ImGui::Text("%.3f", average(passes_[i].gpu_history)); ImGui::NextColumn();
+                ImGui::Text("%.3f", average(passes_[i].cpu_history)); ImGui::NextColumn();
+            }
+            ImGui::Columns(1);
+
+            // state changes of the previous frame, skipped ones never reached the driver
+            const glstate::StateCache &state = glstate::State();
+            ImGui::Columns(3, "state changes", false);
+            ImGui::Text("State"); ImGui::NextColumn();
+            ImGui::Text("Issued"); ImGui::NextColumn();
+            ImGui::Text("Skipped"); ImGui::NextColumn();
+            for (int type = 0; type < glstate::CALL_TYPES; ++type) {
+                ImGui::Text("%s", glstate::CALL_TYPE_NAMES[type]); ImGui::NextColumn();
+                ImGui::Text("%d", state.Issued(type)); ImGui::NextColumn();
+                ImGui::Text("%d", state.Skipped(type)); ImGui::NextColumn();
+            }
+            ImGui::Columns(1);
+
+            if (show_graphs_) {
+                int offset = (history_index_ + 1) % HISTORY_SIZE;
+                ImGui::PlotLines("Frame", frame_history_, HISTORY_SIZE, offset,
+                                 NULL, 0.0f, FLT_MAX, ImVec2(0, 50));
+                for (size_t i = 0; i < passes_.size(); ++i) {
+                    ImGui::PlotLines(passes_[i].name.c_str(), passes_[i].gpu_history, HISTORY_SIZE,
+                                     offset, NULL, 0.0f, FLT_MAX, ImVec2(0, 30));
+                }
+            }
+        }
+
+        // writes the whole history, oldest frame first. A row describes one
+        // frame: its GPU times are collected GPU_LATENCY frames later and its
+        // frame time at the start of the next one, into the slots of those
+        // frames, so only the frames whose times all arrived are written
+        bool ExportCsv(const char *path) const {
+
+            ofstream csv(path, ios::out | ios::trunc);
+            if (!csv.is_open()) {
+                cerr << "Could not write " << path << endl;
+                return false;
+            }
+
+            csv << "frame,frame_ms";
+            for (size_t i = 0; i < passes_.size(); ++i) {
+                csv << "," << passes_[i].name << "_gpu_ms," << passes_[i].name << "_cpu_ms";
+            }
+            csv << endl;
+
+            // the CPU times of the current frame aren't in its slot yet
+            int first = std::max(frame_ - HISTORY_SIZE + 1, 0);
+            for (int frame = first; frame + GPU_LATENCY <= frame_; ++frame) {
+                int slot = frame % HISTORY_SIZE;
+                int next_slot = (frame + 1) % HISTORY_SIZE;
+                int gpu_slot = (frame + GPU_LATENCY) % HISTORY_SIZE;
+                csv << frame << "," << frame_history_[next_slot];
+                for (size_t i = 0; i < passes_.size(); ++i) {
+                    csv << "," << passes_[i].gpu_history[gpu_slot] << "," << passes_[i].cpu_history[slot];
+                }
+                csv << endl;
+            }
+
+            cout << "Profile written to " << path << endl;
+            return true;
+        }
+
+        void Cleanup() {
+            for (size_t i = 0; i < passes_.size(); ++i) {
+                if (timer_queries_) {
+                    glDeleteQueries(2, passes_[i].queries);
+                }
+            }
+            passes_.clear();
+        }
+
+    private:
+        static float elapsedMs(Clock::time_point start, Clock::time_point end) {
+            return std::chrono::duration<float, std::milli>(end - start).count();
+        }
+
+        float average(const float *history) const {
+            int count = frame_ < HISTORY_SIZE ? frame_ : HISTORY_SIZE;
+            if (count == 0) {
+                return 0.0f;
+            }
+            float sum = 0.0f;
+            for (int i = 0; i < count; ++i) {
+                sum += history[i];
+            }
+            return sum / count;
+        }
+
+        float averageGpuFrameTime() const {
+            float total = 0.0f;
+            for (size_t i = 0; i < passes_.size(); ++i) {
+                total += average(passes_[i].gpu_history);
+            }
+            return total;
+        }
+};
+
+// Times the enclosing scope as the given pass, and adds it to the trace
+class ProfileScope {
+
+    private:
+        Profiler &profiler_;
+        int pass_;
+        trace::TraceScope trace_;
+
+    public:
+        ProfileScope(Profiler &profiler, int pass)
+            : profiler_(profiler), pass_(pass), trace_(profiler.PassName(pass).c_str()) {
+            profiler_.Begin(pass_);
+        }
+
+        ~ProfileScope() {
+            profiler_.End(pass_);
+        }
+};
@@ -0,0 +1,150 @@
+#pragma once
+#include "icg_helper.h"
+
+// chosen preset, per renderer, delete it to calibrate again
+static const char* QUALITY_CACHE_PATH = "quality.cfg";
+
+enum QualityLevel {
+    QUALITY_LOW,
+    QUALITY_MEDIUM,
+    QUALITY_HIGH,
+    QUALITY_ULTRA,
+    QUALITY_LEVELS
+};
+
+struct QualityPreset {
+    const char *name;
+    int heightmap_size;             // noise texture, square
+    float tessellation_scale;       // upper bound of the triangle budget governor
+    float triangle_budget;
+    float reflection_scale;         // mirror resolution relative to the window
+    int water_grid;                 // water plane vertices per side
+    bool terrain_shadows;           // horizon map, computed with the heightmap
+};
+
+static const QualityPreset QUALITY_PRESETS[QUALITY_LEVELS] = {
+    { "Low",     512, 0.5f,  1.2e6f, 0.5f,  100, false },
+    { "Medium", 1024, 0.75f, 2.5e6f, 0.75f, 250, true },
+    { "High",   1536, 1.0f,  4e6f,   1.0f,  500, true },
+    { "Ultra",  2048, 1.5f,  8e6f,   1.0f,  500, true },
+};
+
+// returns -1 for an unknown name, case sensitive
+inline int QualityLevelFromName(const string &name) {
+    for (int level = 0; level < QUALITY_LEVELS; ++level) {
+        if (name == QUALITY_PRESETS[level].name) {
+            return level;
+        }
+    }
+    return -1;
+}
+
+// identifies the GPU and driver the cached choice was made for
+inline string QualityCacheKey() {
+    return string((const char*) glGetString(GL_RENDERER)) + " / " +
+           string((const char*) glGetString(GL_VERSION));
+}
+
+// returns -1 when there is no cache or it was written for another renderer
+inline int LoadQualityCache(const char *path) {
+
+    ifstream file(path);
+    if (!file.is_open()) {
+        return -1;
+    }
+
+    string line, renderer, preset;
+    while (getline(file, line)) {
+        size_t separator = line.find('=');
+        if (line.empty() || line[0] == '#' || separator == string::npos) {
+            continue;
+        }
+        string key = line.substr(0, separator);
+        if (key == "renderer") {
+            renderer = line.substr(separator + 1);
+        } else if (key == "preset") {
+            preset = line.substr(separator + 1);
+        }
+    }
+    return renderer == QualityCacheKey() ? QualityLevelFromName(preset) : -1;
+}
+
+inline void SaveQualityCache(const char *path, int level) {
+    ofstream file(path, ios::out | ios::trunc);
+    if (!file.is_open()) {
+        cerr << "Could not write " << path << endl;
+        return;
+    }
+    file << "# quality preset chosen for this renderer, delete to calibrate again" << endl;
+    file << "renderer=" << QualityCacheKey() << endl;
+    file << "preset=" << QUALITY_PRESETS[level].name << endl;
+}
+
+// Renders a few frames with each preset from the lowest up and keeps the
+// highest one whose median frame time fits in the budget. Slow machines stop
+// after the first preset, fast ones go through all of them quickly.
+class QualityCalibration {
+
+    public:
+        static const int WARMUP_FRAMES = 5;     // covers the query lag and the preset switch
+        static const int MEASURED_FRAMES = 15;
+
+    private:
+        bool running_ = false;
+        int level_ = QUALITY_LOW;               // preset being measured
+        int result_ = QUALITY_LOW;
+        int frame_ = 0;
+        float budget_ms_ = 0.0f;
+        vector<float> samples_;
+
+    public:
+        void Start(float budget_ms) {
+            running_ = true;
+            level_ = result_ = QUALITY_LOW;
+            frame_ = 0;
+            budget_ms_ = budget_ms;
+            samples_.clear();
+        }
+
+        bool IsRunning() const {
+            return running_;
+        }
+
+        // preset to render the next frame with
+        int Level() const {
+            return running_ ? level_ : result_;
+        }
+
+        int Result() const {
+            return result_;
+        }
+
+        // takes the frame time of the current preset, returns true when the
+        // preset to render with changed
+        bool Update(float frame_ms) {
+
+            if (!running_ || frame_++ < WARMUP_FRAMES) {
+                return false;
+            }
+            samples_.push_back(frame_ms);
+            if ((int) samples_.size() < MEASURED_FRAMES) {
+                return false;
+            }
+
+            std::nth_element(samples_.begin(), samples_.begin() + samples_.size() / 2, samples_.end());
+            float median_ms = samples_[samples_.size() / 2];
+            printf("Quality %s: %.2f ms\n", QUALITY_PRESETS[level_].name, median_ms);
+
+            if (median_ms <= budget_ms_) {
+                result_ = level_;
+                if (level_ + 1 < QUALITY_LEVELS) {
+                    level_++;
+                    frame_ = 0;
+                    samples_.clear();
+                    return true;
+                }
+            }
+            running_ = false;
+            return level_ != result_;
+        }
+};
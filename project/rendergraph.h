@@ -0,0 +1,294 @@
+#pragma once
+#include "icg_helper.h"
+#include "framebuffer.h"
+
+#include <functional>
+
+// Size and format of a render target, transient targets with equal
+// descriptions share the same pooled framebuffers
+struct RenderTargetDesc {
+    int width;
+    int height;
+    GLint internal_format;
+    bool interpolate;
+
+    bool operator==(const RenderTargetDesc &other) const {
+        return width == other.width && height == other.height &&
+               internal_format == other.internal_format && interpolate == other.interpolate;
+    }
+
+    // color and 32 bit depth
+    size_t Bytes() const {
+        size_t color = internal_format == GL_RGBA32F ? 16 : 4;
+        return (size_t) width * height * (color + 4);
+    }
+};
+
+// Rebuilt every frame: passes are added in execution order with the targets
+// they read and the one they render to. Execute() drops the disabled passes
+// and those whose output nobody reads, gives each transient target a pooled
+// framebuffer for the passes between its first and last use (targets with
+// disjoint lifetimes alias the same one), and frees the pooled framebuffers
+// the frame didn't use, so a resize or a setting that turns a pass off
+// releases its memory.
+//
+//     int color = graph.CreateTarget("Color", desc);
+//     graph.AddPass("Sky", {}, color, !wireframe, [&]() { sky.Draw(...); });
+//     graph.AddPass("Present", {color}, graph.Backbuffer(), true, [&]() { ... });
+//     graph.Execute();
+class RenderGraph {
+
+    public:
+        static const int BACKBUFFER = 0;        // resource id of the default framebuffer
+
+    private:
+        struct Resource {
+            string name;
+            RenderTargetDesc desc;
+            FrameBuffer *imported;          // persistent target owned by the caller
+            int pool_entry;                 // transient target, -1 until allocated
+            int first_use;
+            int last_use;
+            bool needed;
+        };
+
+        struct Pass {
+            string name;
+            vector<int> inputs;
+            int output;
+            bool enabled;
+            std::function<void()> execute;
+            bool culled;
+        };
+
+        struct PoolEntry {
+            RenderTargetDesc desc;
+            FrameBuffer framebuffer;
+            bool in_use;                    // by a live resource of this frame
+            bool used_this_frame;
+        };
+
+        vector<Resource> resources_;
+        vector<Pass> passes_;
+        vector<PoolEntry> pool_;
+        int backbuffer_width_ = WINDOW_WIDTH;
+        int backbuffer_height_ = WINDOW_HEIGHT;
+        int culled_passes_ = 0;
+
+    public:
+        RenderGraph() {
+            Reset();
+        }
+
+        // the window size, viewport of the passes rendering to the backbuffer
+        void SetBackbufferSize(int width, int height) {
+            backbuffer_width_ = width;
+            backbuffer_height_ = height;
+        }
+
+        // starts a new frame, the previous passes and resources are dropped
+        void Reset() {
+            passes_.clear();
+            resources_.clear();
+            Resource backbuffer;
+            backbuffer.name = "Backbuffer";
+            backbuffer.desc = RenderTargetDesc{ backbuffer_width_, backbuffer_height_, GL_RGBA8, false };
+            backbuffer.imported = NULL;
+            backbuffer.pool_entry = -1;
+            resources_.push_back(backbuffer);
+        }
+
+        int Backbuffer() const {
+            return BACKBUFFER;
+        }
+
+        // a target that lives across frames, passes writing to it are never culled
+        int ImportTarget(const string &name, FrameBuffer &framebuffer) {
+            Resource resource;
+            resource.name = name;
+            resource.desc = RenderTargetDesc{ framebuffer.Width(), framebuffer.Height(), GL_NONE, false };
+            resource.imported = &framebuffer;
+            resource.pool_entry = -1;
+            resources_.push_back(resource);
+            return resources_.size() - 1;
+        }
+
+        // a target that only lives during this frame, cleared before its first use
+        int CreateTarget(const string &name, const RenderTargetDesc &desc) {
+            Resource resource;
+            resource.name = name;
+            resource.desc = desc;
+            resource.imported = NULL;
+            resource.pool_entry = -1;
+            resources_.push_back(resource);
+            return resources_.size() - 1;
+        }
+
+        void AddPass(const string &name, const vector<int> &inputs, int output, bool enabled,
+                     std::function<void()> execute) {
+            Pass pass;
+            pass.name = name;
+            pass.inputs = inputs;
+            pass.output = output;
+            pass.enabled = enabled;
+            pass.execute = execute;
+            pass.culled = true;
+            passes_.push_back(pass);
+        }
+
+        void Execute() {
+
+            TRACE_SCOPE("Render graph");
+            cull();
+
+            for (size_t i = 0; i < pool_.size(); ++i) {
+                pool_[i].in_use = pool_[i].used_this_frame = false;
+            }
+
+            for (size_t p = 0; p < passes_.size(); ++p) {
+                Pass &pass = passes_[p];
+                if (pass.culled) {
+                    continue;
+                }
+
+                // targets whose lifetime starts with this pass
+                for (size_t r = 0; r < resources_.size(); ++r) {
+                    if (isTransient(r) && resources_[r].first_use == (int) p) {
+                        allocate(resources_[r]);
+                    }
+                }
+
+                bindOutput(pass.output);
+                pass.execute();
+
+                // and those whose lifetime ends here go back to the pool
+                for (size_t r = 0; r < resources_.size(); ++r) {
+                    if (isTransient(r) && resources_[r].last_use == (int) p) {
+                        pool_[resources_[r].pool_entry].in_use = false;
+                    }
+                }
+            }
+
+            // what this frame didn't need is released
+            for (size_t i = 0; i < pool_.size(); ) {
+                if (!pool_[i].used_this_frame) {
+                    pool_[i].framebuffer.Cleanup();
+                    pool_.erase(pool_.begin() + i);
+                } else {
+                    ++i;
+                }
+            }
+        }
+
+        // the framebuffer of a target, only valid while the passes execute
+        FrameBuffer &Target(int resource) {
+            Resource &target = resources_[resource];
+            return target.imported != NULL ? *target.imported : pool_[target.pool_entry].framebuffer;
+        }
+
+        int PooledTargets() const {
+            return pool_.size();
+        }
+
+        size_t PooledBytes() const {
+            size_t bytes = 0;
+            for (size_t i = 0; i < pool_.size(); ++i) {
+                bytes += pool_[i].desc.Bytes();
+            }
+            return bytes;
+        }
+
+        // passes of the last frame that were disabled or had no reader
+        int CulledPasses() const {
+            return culled_passes_;
+        }
+
+        void Cleanup() {
+            for (size_t i = 0; i < pool_.size(); ++i) {
+                pool_[i].framebuffer.Cleanup();
+            }
+            pool_.clear();
+            Reset();
+        }
+
+    private:
+        bool isTransient(size_t resource) const {
+            return resource != BACKBUFFER && resources_[resource].imported == NULL &&
+                   resources_[resource].needed;
+        }
+
+        // walks the passes backwards: a pass is kept when it is enabled and
+        // renders to the backbuffer, an imported target or a target that a
+        // kept pass reads; the targets it reads become needed in turn
+        void cull() {
+
+            for (size_t r = 0; r < resources_.size(); ++r) {
+                resources_[r].needed = r == BACKBUFFER || resources_[r].imported != NULL;
+                resources_[r].first_use = resources_[r].last_use = -1;
+            }
+
+            culled_passes_ = 0;
+            for (int p = passes_.size() - 1; p >= 0; --p) {
+                Pass &pass = passes_[p];
+                pass.culled = !pass.enabled || !resources_[pass.output].needed;
+                if (pass.culled) {
+                    culled_passes_++;
+                    continue;
+                }
+                for (size_t i = 0; i < pass.inputs.size(); ++i) {
+                    resources_[pass.inputs[i]].needed = true;
+                }
+            }
+
+            // lifetimes of the transient targets, in pass indices
+            for (size_t p = 0; p < passes_.size(); ++p) {
+                if (passes_[p].culled) {
+                    continue;
+                }
+                vector<int> used = passes_[p].inputs;
+                used.push_back(passes_[p].output);
+                for (size_t i = 0; i < used.size(); ++i) {
+                    Resource &resource = resources_[used[i]];
+                    resource.first_use = resource.first_use < 0 ? p : resource.first_use;
+                    resource.last_use = p;
+                }
+            }
+        }
+
+        // reuses a free framebuffer of the same description or creates one
+        void allocate(Resource &resource) {
+
+            resource.pool_entry = -1;
+            for (size_t i = 0; i < pool_.size(); ++i) {
+                if (!pool_[i].in_use && pool_[i].desc == resource.desc) {
+                    resource.pool_entry = i;
+                    break;
+                }
+            }
+            if (resource.pool_entry < 0) {
+                PoolEntry entry;
+                entry.desc = resource.desc;
+                entry.framebuffer.Init(resource.desc.width, resource.desc.height,
+                                       resource.desc.interpolate, resource.desc.internal_format,
+                                       resource.name);
+                pool_.push_back(entry);
+                resource.pool_entry = pool_.size() - 1;
+            }
+
+            PoolEntry &entry = pool_[resource.pool_entry];
+            entry.in_use = entry.used_this_frame = true;
+
+            // an aliased framebuffer holds what the previous target left in it
+            entry.framebuffer.Bind();
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        }
+
+        void bindOutput(int output) {
+            if (output == BACKBUFFER) {
+                glstate::State().BindFramebuffer(GL_FRAMEBUFFER, 0);
+                glViewport(0, 0, backbuffer_width_, backbuffer_height_);
+            } else {
+                Target(output).Bind();
+            }
+        }
+};
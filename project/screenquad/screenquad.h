@@ -1,6 +1,7 @@
 #pragma once
 #include "icg_helper.h"
 #include "config.h"
+#include "noise.h"
 
 #include "array"
 
@@ -10,6 +11,7 @@ class ScreenQuad {
         GLuint vertex_array_id_;        // vertex array object
         GLuint program_id_;             // GLSL shader program ID
         GLuint vertex_buffer_object_;   // memory buffer
+        GLuint texcoord_buffer_object_;
 
         float screenquad_width_;
         float screenquad_height_;
@@ -22,26 +24,44 @@ class ScreenQuad {
         int octaves = INITIAL_OCTAVES;
         float cutoff_coef = INITIAL_CUT_COEFF;
         float offset = INITIAL_OFFSET;
+        int version_ = 0;               // changes with the noise parameters
 
     public:
         // Perlin noise parameters
         void setScaleFactor(int newValue) {
             scaleFactor = newValue;
+            version_++;
         }
         void setH(int newValue) {
             H = newValue;
+            version_++;
         }
         void setLacunarity(int newValue) {
             lacunarity = newValue;
+            version_++;
         }
         void setOctaves(int newValue) {
             octaves = newValue;
+            version_++;
         }
         void setCutoffCoef(int newValue) {
             cutoff_coef = newValue;
+            version_++;
         }
         void setOffset(int newValue) {
             offset = newValue;
+            version_++;
+        }
+
+        // noise rendered with other parameters is stale
+        int Version() const {
+            return version_;
+        }
+
+        // for evaluating the same noise with noise::Height()
+        NoiseParameters Parameters() const {
+            NoiseParameters parameters = { scaleFactor, H, lacunarity, octaves, cutoff_coef, offset };
+            return parameters;
         }
 
         void Init(float screenquad_width, float screenquad_height) {
@@ -62,11 +82,11 @@ class ScreenQuad {
                 exit(EXIT_FAILURE);
             }
 
-            glUseProgram(program_id_);
+            glstate::State().UseProgram(program_id_);
 
             // vertex one vertex Array
             glGenVertexArrays(1, &vertex_array_id_);
-            glBindVertexArray(vertex_array_id_);
+            glstate::State().BindVertexArray(vertex_array_id_);
 
             // vertex coordinates
             {
@@ -79,6 +99,8 @@ class ScreenQuad {
                 glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_object_);
                 glBufferData(GL_ARRAY_BUFFER, sizeof(vertex_point),
                              vertex_point, GL_STATIC_DRAW);
+                gpumemory::Registry().Track(GL_BUFFER, vertex_buffer_object_, gpumemory::MEMORY_BUFFERS,
+                                            "Screen quad vertices", sizeof(vertex_point));
 
                 // attribute
                 GLuint vertex_point_id = glGetAttribLocation(program_id_, "vpoint");
@@ -95,10 +117,12 @@ class ScreenQuad {
                                                                /*V4*/ 1.0f, 1.0f};
 
                 // buffer
-                glGenBuffers(1, &vertex_buffer_object_);
-                glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_object_);
+                glGenBuffers(1, &texcoord_buffer_object_);
+                glBindBuffer(GL_ARRAY_BUFFER, texcoord_buffer_object_);
                 glBufferData(GL_ARRAY_BUFFER, sizeof(vertex_texture_coordinates),
                              vertex_texture_coordinates, GL_STATIC_DRAW);
+                gpumemory::Registry().Track(GL_BUFFER, texcoord_buffer_object_, gpumemory::MEMORY_BUFFERS,
+                                            "Screen quad texture coordinates", sizeof(vertex_texture_coordinates));
 
                 // attribute
                 GLuint vertex_texture_coord_id = glGetAttribLocation(program_id_,
@@ -117,8 +141,8 @@ class ScreenQuad {
             glUniform1f(world_size_id, WORLD_SIZE);
 
             // to avoid the current object being polluted
-            glBindVertexArray(0);
-            glUseProgram(0);
+            glstate::State().BindVertexArray(0);
+            glstate::State().UseProgram(0);
         }
 
         void setCenter(glm::vec2 newCenter) {
@@ -131,16 +155,31 @@ class ScreenQuad {
         }
 
         void Cleanup() {
-            glBindVertexArray(0);
-            glUseProgram(0);
+            glstate::State().BindVertexArray(0);
+            glstate::State().UseProgram(0);
             glDeleteBuffers(1, &vertex_buffer_object_);
-            glDeleteProgram(program_id_);
-            glDeleteVertexArrays(1, &vertex_array_id_);
+            glDeleteBuffers(1, &texcoord_buffer_object_);
+            gpumemory::Registry().Release(GL_BUFFER, vertex_buffer_object_);
+            gpumemory::Registry().Release(GL_BUFFER, texcoord_buffer_object_);
+            glstate::State().DeleteProgram(program_id_);
+            glstate::State().DeleteVertexArrays(1, &vertex_array_id_);
         }
 
+        // the noise of the unit square at center
         void Draw() {
-            glUseProgram(program_id_);
-            glBindVertexArray(vertex_array_id_);
+            drawNoise(center, glm::vec2(0.0f), 1.0f);
+        }
+
+        // the noise of the square of the given origin and size, independent
+        // of the center
+        void DrawRegion(glm::vec2 origin, float size) {
+            drawNoise(glm::vec2(0.0f), origin, size);
+        }
+
+    private:
+        void drawNoise(glm::vec2 noise_center, glm::vec2 region_origin, float region_size) {
+            glstate::State().UseProgram(program_id_);
+            glstate::State().BindVertexArray(vertex_array_id_);
 
             // Perlin noise parameters
             GLuint scaleFactor_id = glGetUniformLocation(program_id_, "scaleFactor");
@@ -163,12 +202,11 @@ class ScreenQuad {
 
             // pass terrain coord to shader
             GLuint center_id = glGetUniformLocation(program_id_, "center");
-            glUniform2fv(center_id, 1, &center[0]);
+            glUniform2fv(center_id, 1, &noise_center[0]);
+            glUniform2fv(glGetUniformLocation(program_id_, "region_origin"), 1, &region_origin[0]);
+            glUniform1f(glGetUniformLocation(program_id_, "region_size"), region_size);
 
             // draw
             glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-
-            glBindVertexArray(0);
-            glUseProgram(0);
         }
 };
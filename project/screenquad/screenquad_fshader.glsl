@@ -12,6 +12,8 @@ uniform int octaves;            // Number of octaves
 uniform float cutoff_coef;    // Rescale final value (i.e. the height)
 uniform float offset;
 uniform vec2 center;
+uniform vec2 region_origin;   // of the rendered region relative to the center
+uniform float region_size;
 
 float fade(float t) {
     return t * t * t * (t * (t * 6 - 15) + 10);
@@ -24,11 +26,12 @@ float noise(vec2 coord) {
     int yi = int(pi.y);
     vec2 pf = fract(coord);
 
+    // masked rather than %, which is undefined for negative coordinates
     int i1, i2, i3, i4;
-    i1 = permutation[(permutation[xi%256] + yi)%256]%8;
-    i2 = permutation[(permutation[xi%256] + yi + 1)%256]%8;
-    i3 = permutation[(permutation[(xi + 1)%256] + yi + 1)%256]%8;
-    i4 = permutation[(permutation[(xi + 1)%256] + yi)%256]%8;
+    i1 = permutation[(permutation[xi & 255] + yi) & 255] & 7;
+    i2 = permutation[(permutation[xi & 255] + yi + 1) & 255] & 7;
+    i3 = permutation[(permutation[(xi + 1) & 255] + yi + 1) & 255] & 7;
+    i4 = permutation[(permutation[(xi + 1) & 255] + yi) & 255] & 7;
 
     vec2 g[8];
     g[0] = vec2(1, 0);
@@ -86,7 +89,7 @@ float fBm(vec2 coord, float H, float lacunarity, int octaves, float offset) {
 
 void main() {
 
-    vec2 coord = (uv + center)*scaleFactor;
+    vec2 coord = (uv*region_size + region_origin + center)*scaleFactor;
     float noise = fBm(coord, H, lacunarity, octaves, offset)*cutoff_coef-0.9;
 
     color = vec3(noise, noise, noise);
@@ -0,0 +1,385 @@
+#pragma once
+#include "icg_helper.h"
+#include "config.h"
+#include "framebuffer.h"
+#include "textureloader.h"
+#include "projection.h"
+#include "screenquad/screenquad.h"
+#include "terrain/terrain.h"
+#include "water/water.h"
+
+#include <chrono>
+#include <functional>
+#include <thread>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+struct ShaderBenchmarkOptions {
+    vector<int> sizes = { 256, 512, 1024 };     // square targets, pixels per side
+    int draws = 20;                 // per timed repetition
+    int repetitions = 5;            // the median is reported
+    int max_octaves = 16;           // the range of the octaves slider
+    string output;                  // JSON report, stdout if empty
+};
+
+// Times the fragment heavy shaders in isolation: the fBm of the screen quad
+// at every octave count, the terrain and the water. Each kernel is drawn
+// many times into offscreen targets of every size, timed both with
+// GL_TIME_ELAPSED queries and with the CPU clock between two glFinish, and
+// reported per target pixel and per shaded fragment. Over several sizes, a
+// least squares fit of the draw time against the pixels separates the cost
+// per pixel from the fixed one, e.g. the tessellation of the terrain.
+//
+// On GPUs the query times are the precise ones. Software rasterizers like
+// llvmpipe end the query when the draws are queued, before rasterizing
+// them, only the wall times are meaningful there.
+//
+// The camera, light and tessellation levels are fixed, every draw shades
+// the same fragments. The terrain and water draws clear the depth buffer
+// first, the "clear" kernel measures that alone. Expects a current context.
+class ShaderBenchmark {
+
+    private:
+        typedef std::chrono::steady_clock Clock;
+
+        static const int HEIGHTMAP_SIZE = 1024;
+
+        // medians of the repetitions, per draw
+        struct Measure {
+            int size;
+            double gpu_ms;                  // 0 without timer queries
+            double wall_ms;
+            GLuint64 fragments;
+        };
+
+        struct Kernel {
+            string name;
+            vector<Measure> measures;
+        };
+
+        vector<Kernel> kernels_;
+        FILE *log_ = stdout;                // stderr when the report goes to stdout
+        bool timer_queries_ = false;
+        GLuint time_query_ = 0;
+        GLuint samples_query_ = 0;
+
+        TextureLoader texture_loader_;
+        FrameBuffer heightmap_;
+        ScreenQuad screenquad_;
+        Terrain terrain_;
+        Water water_;
+
+    public:
+        int Run(const ShaderBenchmarkOptions &options) {
+
+            log_ = options.output.empty() ? stderr : stdout;
+
+            timer_queries_ = GLEW_VERSION_3_3 || icg_helper::HasExtension("GL_ARB_timer_query");
+            if (!timer_queries_) {
+                fprintf(log_, "Timer queries not supported, timing with glFinish\n");
+            } else {
+                glGenQueries(1, &time_query_);
+            }
+            glGenQueries(1, &samples_query_);
+            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+            glstate::State().Enable(GL_DEPTH_TEST);
+
+            initObjects();
+
+            glm::mat4 model = IDENTITY_MATRIX;
+            glm::mat4 view = glm::lookAt(INITIAL_EYE, INITIAL_EYE + INITIAL_FRONT, INITIAL_UP);
+            glm::vec3 mirror_eye = glm::vec3(INITIAL_EYE.x, -INITIAL_EYE.y, INITIAL_EYE.z);
+            glm::vec3 mirror_front = glm::vec3(INITIAL_FRONT.x, -INITIAL_FRONT.y, INITIAL_FRONT.z);
+            glm::mat4 view_reflection = glm::lookAt(mirror_eye, mirror_eye + mirror_front,
+                                                    glm::vec3(0.0f, -1.0f, 0.0f));
+            glm::mat4 projection = PerspectiveProjection(START_CAM_FOV, 1.0f, CAM_NEAR, CAM_FAR);
+            const float light_angle = 1.0f;
+
+            for (size_t s = 0; s < options.sizes.size(); ++s) {
+                int size = options.sizes[s];
+                FrameBuffer target;
+                target.Init(size, size, false, GL_RGBA8, "Shader benchmark");
+
+                // the reflection of the terrain, sampled by the water
+                FrameBuffer mirror;
+                mirror.Init(size, size, true, GL_RGBA8, "Shader benchmark reflection");
+                mirror.Bind();
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                glstate::State().Enable(GL_CLIP_DISTANCE0);
+                terrain_.Draw(model, view_reflection, projection, 1, light_angle, 0.0f);
+                glstate::State().Disable(GL_CLIP_DISTANCE0);
+                mirror.Unbind();
+
+                target.Bind();
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+                // a full screen quad, the depth test would reject the draws
+                // after the first one
+                glstate::State().Disable(GL_DEPTH_TEST);
+                for (int octaves = 1; octaves <= options.max_octaves; ++octaves) {
+                    screenquad_.setOctaves(octaves);
+                    char name[32];
+                    snprintf(name, sizeof(name), "noise_%d_octaves", octaves);
+                    measure(name, size, options, [&]() {
+                        screenquad_.Draw();
+                    });
+                }
+                glstate::State().Enable(GL_DEPTH_TEST);
+
+                measure("clear", size, options, [&]() {
+                    glClear(GL_DEPTH_BUFFER_BIT);
+                });
+                measure("terrain", size, options, [&]() {
+                    glClear(GL_DEPTH_BUFFER_BIT);
+                    terrain_.Draw(model, view, projection, 0, light_angle, 0.0f);
+                });
+
+                water_.setViewportSize(size, size);
+                water_.setMirrorScale(glm::vec2(1.0f, 1.0f));
+                water_.setMirrorTexture(mirror.ColorTexture());
+                measure("water", size, options, [&]() {
+                    glClear(GL_DEPTH_BUFFER_BIT);
+                    water_.Draw(0.0f, model, view, projection, light_angle);
+                });
+
+                target.Unbind();
+                mirror.Cleanup();
+                target.Cleanup();
+            }
+
+            cleanup();
+            printSummary();
+            return writeReport(options) ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+
+    private:
+        void initObjects() {
+
+            texture_loader_.Init();
+
+            // the terrain is displaced by the noise of the default parameters
+            screenquad_.Init(HEIGHTMAP_SIZE, HEIGHTMAP_SIZE);
+            GLuint heightmap_texture = heightmap_.Init(HEIGHTMAP_SIZE, HEIGHTMAP_SIZE, true,
+                                                       GL_RGBA32F, "Heightmap");
+            heightmap_.Bind();
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            screenquad_.Draw();
+            heightmap_.Unbind();
+
+            terrain_.Init(heightmap_texture, texture_loader_);
+            terrain_.setTessellationScale(1.0f);
+            terrain_.HeightmapChanged(HEIGHTMAP_SIZE);
+            water_.Init(0, texture_loader_, RESOLUTION);
+
+            // every texture in place before anything is timed
+            while (!texture_loader_.IsIdle()) {
+                texture_loader_.Update();
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            texture_loader_.Update();
+            glFinish();
+        }
+
+        void cleanup() {
+            water_.Cleanup();
+            terrain_.Cleanup();
+            screenquad_.Cleanup();
+            heightmap_.Cleanup();
+            texture_loader_.Cleanup();
+            if (timer_queries_) {
+                glDeleteQueries(1, &time_query_);
+            }
+            glDeleteQueries(1, &samples_query_);
+        }
+
+        void measure(const string &name, int size, const ShaderBenchmarkOptions &options,
+                     const std::function<void()> &draw) {
+
+            // not timed: the first use of a program or texture may be slower
+            draw();
+
+            Measure result;
+            result.size = size;
+            glBeginQuery(GL_SAMPLES_PASSED, samples_query_);
+            draw();
+            glEndQuery(GL_SAMPLES_PASSED);
+            glGetQueryObjectui64v(samples_query_, GL_QUERY_RESULT, &result.fragments);
+            glFinish();
+
+            vector<double> gpu_ms, wall_ms;
+            for (int repetition = 0; repetition < options.repetitions; ++repetition) {
+                double gpu, wall;
+                timeDraws(draw, options.draws, gpu, wall);
+                gpu_ms.push_back(gpu / options.draws);
+                wall_ms.push_back(wall / options.draws);
+            }
+            result.gpu_ms = median(gpu_ms);
+            result.wall_ms = median(wall_ms);
+
+            kernel(name).measures.push_back(result);
+            double pixels = (double) size * size;
+            fprintf(log_, "%-18s %5d x %-5d", name.c_str(), size, size);
+            if (timer_queries_) {
+                fprintf(log_, " gpu %9.3f ms %9.3f ns/pixel", result.gpu_ms,
+                        result.gpu_ms * 1e6 / pixels);
+            }
+            fprintf(log_, " wall %9.3f ms %9.3f ns/pixel %9llu fragments\n", result.wall_ms,
+                    result.wall_ms * 1e6 / pixels, (unsigned long long) result.fragments);
+            fflush(log_);
+        }
+
+        // ms for count draws by the timer query, 0 without, and by the clock
+        void timeDraws(const std::function<void()> &draw, int count, double &gpu_ms, double &wall_ms) {
+            glFinish();
+            Clock::time_point start = Clock::now();
+            if (timer_queries_) {
+                glBeginQuery(GL_TIME_ELAPSED, time_query_);
+            }
+            for (int i = 0; i < count; ++i) {
+                draw();
+            }
+            if (timer_queries_) {
+                glEndQuery(GL_TIME_ELAPSED);
+            }
+            glFinish();
+            wall_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+            GLuint64 elapsed = 0;
+            if (timer_queries_) {
+                glGetQueryObjectui64v(time_query_, GL_QUERY_RESULT, &elapsed);
+            }
+            gpu_ms = elapsed / 1e6;
+        }
+
+        static double median(vector<double> values) {
+            std::sort(values.begin(), values.end());
+            return values[values.size() / 2];
+        }
+
+        Kernel &kernel(const string &name) {
+            for (size_t i = 0; i < kernels_.size(); ++i) {
+                if (kernels_[i].name == name) {
+                    return kernels_[i];
+                }
+            }
+            Kernel kernel;
+            kernel.name = name;
+            kernels_.push_back(kernel);
+            return kernels_.back();
+        }
+
+        // least squares fit of the ns per draw of one of the times against
+        // the pixels, false with fewer than two sizes
+        static bool fit(const Kernel &kernel, double Measure::*time, double &ns_per_pixel,
+                        double &fixed_ns) {
+            size_t n = kernel.measures.size();
+            if (n < 2) {
+                return false;
+            }
+            double mean_x = 0.0, mean_y = 0.0;
+            for (size_t i = 0; i < n; ++i) {
+                mean_x += (double) kernel.measures[i].size * kernel.measures[i].size / n;
+                mean_y += kernel.measures[i].*time * 1e6 / n;
+            }
+            double covariance = 0.0, variance = 0.0;
+            for (size_t i = 0; i < n; ++i) {
+                double x = (double) kernel.measures[i].size * kernel.measures[i].size - mean_x;
+                covariance += x * (kernel.measures[i].*time * 1e6 - mean_y);
+                variance += x * x;
+            }
+            if (variance <= 0.0) {
+                return false;
+            }
+            ns_per_pixel = covariance / variance;
+            fixed_ns = mean_y - ns_per_pixel * mean_x;
+            return true;
+        }
+
+        void printSummary() {
+            for (size_t i = 0; i < kernels_.size(); ++i) {
+                double ns_per_pixel, fixed_ns;
+                if (timer_queries_ && fit(kernels_[i], &Measure::gpu_ms, ns_per_pixel, fixed_ns)) {
+                    fprintf(log_, "%-18s gpu  %9.3f ns/pixel + %10.1f us/draw\n",
+                            kernels_[i].name.c_str(), ns_per_pixel, fixed_ns / 1e3);
+                }
+                if (fit(kernels_[i], &Measure::wall_ms, ns_per_pixel, fixed_ns)) {
+                    fprintf(log_, "%-18s wall %9.3f ns/pixel + %10.1f us/draw\n",
+                            kernels_[i].name.c_str(), ns_per_pixel, fixed_ns / 1e3);
+                }
+            }
+        }
+
+        static void writeTimes(FILE *out, const char *name, double ms, double pixels,
+                               GLuint64 fragments) {
+            fprintf(out, "\"%s\": { \"ms_per_draw\": %.4f, \"ns_per_pixel\": %.4f, "
+                         "\"ns_per_fragment\": %.4f }",
+                    name, ms, ms * 1e6 / pixels, fragments > 0 ? ms * 1e6 / fragments : 0.0);
+        }
+
+        static void writeFit(FILE *out, const char *name, const Kernel &kernel, double Measure::*time) {
+            double ns_per_pixel, fixed_ns;
+            if (fit(kernel, time, ns_per_pixel, fixed_ns)) {
+                fprintf(out, ",\n      \"%s\": { \"ns_per_pixel\": %.4f, \"fixed_us\": %.2f }",
+                        name, ns_per_pixel, fixed_ns / 1e3);
+            }
+        }
+
+        static string escape(const char *text) {
+            string result;
+            for (const char *c = text; c != NULL && *c != '\0'; ++c) {
+                if (*c == '"' || *c == '\\') {
+                    result += '\\';
+                }
+                result += *c;
+            }
+            return result;
+        }
+
+        bool writeReport(const ShaderBenchmarkOptions &options) {
+
+            FILE *out = stdout;
+            if (!options.output.empty()) {
+                out = fopen(options.output.c_str(), "w");
+                if (out == NULL) {
+                    fprintf(stderr, "Could not write %s\n", options.output.c_str());
+                    return false;
+                }
+            }
+
+            fprintf(out, "{\n");
+            fprintf(out, "  \"renderer\": \"%s\",\n", escape((const char *) glGetString(GL_RENDERER)).c_str());
+            fprintf(out, "  \"version\": \"%s\",\n", escape((const char *) glGetString(GL_VERSION)).c_str());
+            fprintf(out, "  \"timer_queries\": %s,\n", timer_queries_ ? "true" : "false");
+            fprintf(out, "  \"draws\": %d,\n  \"repetitions\": %d,\n", options.draws, options.repetitions);
+            fprintf(out, "  \"kernels\": {\n");
+            for (size_t k = 0; k < kernels_.size(); ++k) {
+                const Kernel &kernel = kernels_[k];
+                fprintf(out, "    \"%s\": {\n      \"sizes\": [\n", kernel.name.c_str());
+                for (size_t i = 0; i < kernel.measures.size(); ++i) {
+                    const Measure &measure = kernel.measures[i];
+                    double pixels = (double) measure.size * measure.size;
+                    fprintf(out, "        { \"width\": %d, \"height\": %d, \"fragments\": %llu, ",
+                            measure.size, measure.size, (unsigned long long) measure.fragments);
+                    if (timer_queries_) {
+                        writeTimes(out, "gpu", measure.gpu_ms, pixels, measure.fragments);
+                        fprintf(out, ", ");
+                    }
+                    writeTimes(out, "wall", measure.wall_ms, pixels, measure.fragments);
+                    fprintf(out, " }%s\n", i + 1 < kernel.measures.size() ? "," : "");
+                }
+                fprintf(out, "      ]");
+                if (timer_queries_) {
+                    writeFit(out, "gpu_fit", kernel, &Measure::gpu_ms);
+                }
+                writeFit(out, "wall_fit", kernel, &Measure::wall_ms);
+                fprintf(out, "\n    }%s\n", k + 1 < kernels_.size() ? "," : "");
+            }
+            fprintf(out, "  }\n}\n");
+
+            if (out != stdout) {
+                fclose(out);
+                printf("Shader benchmark report written to %s\n", options.output.c_str());
+            }
+            return true;
+        }
+};
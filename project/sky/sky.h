@@ -1,6 +1,7 @@
 #pragma once
 #include "icg_helper.h"
 #include "config.h"
+#include "textureloader.h"
 #include "glm/gtc/type_ptr.hpp"
 
 static const int half_size = WORLD_SIZE/2;
@@ -97,10 +98,11 @@ class Sky {
         GLuint vertex_array_id_;        // vertex array object
         GLuint program_id_;             // GLSL shader program ID
         GLuint vertex_buffer_object_;   // memory buffer
+        GLuint texcoord_buffer_object_;
         GLuint texture_id_;             // texture ID
 
     public:
-        void Init() {
+        void Init(TextureLoader &loader) {
             // compile the shaders.
             program_id_ = icg_helper::LoadShaders("sky_vshader.glsl",
                                                   "sky_fshader.glsl",
@@ -110,11 +112,11 @@ class Sky {
                 exit(EXIT_FAILURE);
             }
 
-            glUseProgram(program_id_);
+            glstate::State().UseProgram(program_id_);
 
             // vertex one vertex array
             glGenVertexArrays(1, &vertex_array_id_);
-            glBindVertexArray(vertex_array_id_);
+            glstate::State().BindVertexArray(vertex_array_id_);
 
             // vertex coordinates
             {
@@ -123,6 +125,8 @@ class Sky {
                 glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_object_);
                 glBufferData(GL_ARRAY_BUFFER, NbCubeVertices * sizeof(glm::vec3),
                              &CubeVertices[0], GL_STATIC_DRAW);
+                gpumemory::Registry().Track(GL_BUFFER, vertex_buffer_object_, gpumemory::MEMORY_BUFFERS,
+                                            "Sky vertices", NbCubeVertices * sizeof(glm::vec3));
 
                 // attribute
                 GLuint vertex_point_id = glGetAttribLocation(program_id_, "vpoint");
@@ -135,10 +139,12 @@ class Sky {
             // texture coordinates
             {
                 // buffer
-                glGenBuffers(1, &vertex_buffer_object_);
-                glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_object_);
+                glGenBuffers(1, &texcoord_buffer_object_);
+                glBindBuffer(GL_ARRAY_BUFFER, texcoord_buffer_object_);
                 glBufferData(GL_ARRAY_BUFFER, NbCubeUVs * sizeof(glm::vec2),
                              &CubeUVs[0], GL_STATIC_DRAW);
+                gpumemory::Registry().Track(GL_BUFFER, texcoord_buffer_object_, gpumemory::MEMORY_BUFFERS,
+                                            "Sky texture coordinates", NbCubeUVs * sizeof(glm::vec2));
 
                 // attribute
                 GLuint vertex_texture_coord_id = glGetAttribLocation(program_id_,
@@ -151,20 +157,23 @@ class Sky {
 
 
             // load texture
-            initTexture("sky1c.tga", &texture_id_, "cubemap", GL_TEXTURE0);
+            initTexture(loader, "sky1c.tga", &texture_id_, "cubemap", GL_TEXTURE0);
 
             // to avoid the current object being polluted
-            glBindVertexArray(0);
-            glUseProgram(0);
+            glstate::State().BindVertexArray(0);
+            glstate::State().UseProgram(0);
         }
 
         void Cleanup() {
-            glBindVertexArray(0);
-            glUseProgram(0);
+            glstate::State().BindVertexArray(0);
+            glstate::State().UseProgram(0);
             glDeleteBuffers(1, &vertex_buffer_object_);
-            glDeleteProgram(program_id_);
-            glDeleteVertexArrays(1, &vertex_array_id_);
-            glDeleteTextures(1, &texture_id_);
+            glDeleteBuffers(1, &texcoord_buffer_object_);
+            gpumemory::Registry().Release(GL_BUFFER, vertex_buffer_object_);
+            gpumemory::Registry().Release(GL_BUFFER, texcoord_buffer_object_);
+            glstate::State().DeleteProgram(program_id_);
+            glstate::State().DeleteVertexArrays(1, &vertex_array_id_);
+            glstate::State().DeleteTextures(1, &texture_id_);
         }
 
         void Draw(const glm::mat4& model, const glm::mat4& view,const glm::mat4& projection, bool clip, float lightAngle) {
@@ -172,8 +181,8 @@ class Sky {
             // Compute MVP matrix
             glm::mat4 MVP = projection * view * model;
 
-            glUseProgram(program_id_);
-            glBindVertexArray(vertex_array_id_);
+            glstate::State().UseProgram(program_id_);
+            glstate::State().BindVertexArray(vertex_array_id_);
 
             // Day/night
             GLuint lightAngle_id = glGetUniformLocation(program_id_, "lightAngle");
@@ -181,8 +190,7 @@ class Sky {
 
 
             // bind textures
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, texture_id_);
+            glstate::State().BindTexture(0, GL_TEXTURE_2D, texture_id_);
 
             // pass clip
             GLuint clip_id = glGetUniformLocation(program_id_, "clip");
@@ -194,44 +202,14 @@ class Sky {
             
             // draw
             glDrawArrays(GL_TRIANGLES,0,NbCubeVertices);
-
-            glBindVertexArray(0);
-            glUseProgram(0);
         }
 
-        void initTexture(string filename, GLuint *texture_id, string texture_name, int val) {
-
-                int width;
-                int height;
-                int nb_component;
-                // set stb_image to have the same coordinates as OpenGL
-                stbi_set_flip_vertically_on_load(1);
-                unsigned char *image = stbi_load(filename.c_str(), &width, &height, &nb_component, 0);
-
-                if (image == nullptr) {
-                    throw(string("Failed to load texture"));
-                }
-
-                glGenTextures(1, texture_id);
-                glBindTexture(GL_TEXTURE_2D, *texture_id);
-                glGenerateMipmap(GL_TEXTURE_2D);
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-
-                if (nb_component == 3) {
-                    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-                } else if (nb_component == 4) {
-                    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-                }
+        void initTexture(TextureLoader &loader, string filename, GLuint *texture_id,
+                         string texture_name, int val) {
+
+                *texture_id = loader.Load(filename, false);
 
                 GLuint tex_id = glGetUniformLocation(program_id_, texture_name.c_str());
-                //glUseProgram(program_id_);
                 glUniform1i(tex_id, val - GL_TEXTURE0);
-
-                // cleanup
-                glBindTexture(GL_TEXTURE_2D, val);
-                stbi_image_free(image);
             }
 };
@@ -0,0 +1,131 @@
+#version 430 core
+
+// Horizon map of the heightmap: layer k holds the sine of the elevation of
+// the horizon seen from each texel towards azimuth k*45 degrees (u axis
+// first, counterclockwise), layer 8 the ambient occlusion they give.
+//
+// stage 0: one invocation per line of texels along a direction. The line is
+// walked from its far end, keeping the upper convex hull of the heights met
+// so far; the horizon of a texel is the top of the hull once the points
+// it hides are popped, so each line costs time linear in its length.
+// stage 1: one invocation per texel, averages the 8 horizons.
+layout (local_size_x = 64) in;
+
+layout (r8, binding = 0) uniform image2DArray horizons;
+
+uniform sampler2D heightmap;
+uniform int stage;
+uniform int size;                   // of the horizon map, square
+uniform float texel_size;           // in world units
+uniform float height_scale;         // world height of a heightmap value of 1
+
+const int DIRECTIONS = 8;
+const int AO_LAYER = 8;
+
+// deeper hulls drop their farthest point, the far horizon is rarely the highest
+const int HULL_SIZE = 64;
+
+// stored as unsigned normalized
+void storeHorizon(ivec2 texel, int layer, float horizon) {
+    imageStore(horizons, ivec3(texel, layer), vec4(horizon*0.5 + 0.5));
+}
+
+float loadHorizon(ivec2 texel, int layer) {
+    return imageLoad(horizons, ivec3(texel, layer)).r*2.0 - 1.0;
+}
+
+void sweep(int line, int direction) {
+
+    // the walk goes opposite to the direction, one texel per step along the
+    // major axis and 0 or 1 along the minor one
+    const ivec2 DIRECTION_STEPS[DIRECTIONS] = ivec2[](
+        ivec2(1, 0), ivec2(1, 1), ivec2(0, 1), ivec2(-1, 1),
+        ivec2(-1, 0), ivec2(-1, -1), ivec2(0, -1), ivec2(1, -1));
+    ivec2 walk = -DIRECTION_STEPS[direction];
+    bool major_x = walk.x != 0;
+    int major_step = major_x ? walk.x : walk.y;
+    int minor_step = major_x ? walk.y : walk.x;
+
+    // diagonal lines start outside of the map so that every texel is on one
+    int lines = size + abs(minor_step)*(size - 1);
+    if (line >= lines) {
+        return;
+    }
+    int minor_start = minor_step > 0 ? line - (size - 1) : line;
+    int major_start = major_step > 0 ? 0 : size - 1;
+
+    // steps whose minor coordinate is inside the map
+    int first = 0;
+    int last = size;
+    if (minor_step > 0) {
+        first = max(0, -minor_start);
+        last = min(size, size - minor_start);
+    } else if (minor_step < 0) {
+        first = max(0, minor_start - (size - 1));
+        last = min(size, minor_start + 1);
+    }
+
+    float step_length = texel_size*length(vec2(walk));
+
+    // (distance along the walk, height), nearest point on top
+    vec2 hull[HULL_SIZE];
+    int bottom = 0;
+    int count = 0;
+
+    for (int i = first; i < last; ++i) {
+        int major = major_start + i*major_step;
+        int minor = minor_start + i*minor_step;
+        ivec2 texel = major_x ? ivec2(major, minor) : ivec2(minor, major);
+
+        vec2 point = vec2(i*step_length,
+                          texture(heightmap, (vec2(texel) + 0.5)/float(size)).r*height_scale);
+
+        // pops the points below the line from this one to the next
+        while (count >= 2) {
+            vec2 top = hull[(bottom + count - 1) % HULL_SIZE];
+            vec2 next = hull[(bottom + count - 2) % HULL_SIZE];
+            if ((next.y - point.y)*(point.x - top.x) >= (top.y - point.y)*(point.x - next.x)) {
+                count--;
+            } else {
+                break;
+            }
+        }
+
+        // nothing ahead at the edge of the map, flat horizon
+        float horizon = 0.0;
+        if (count > 0) {
+            vec2 top = hull[(bottom + count - 1) % HULL_SIZE];
+            vec2 delta = vec2(point.x - top.x, top.y - point.y);
+            horizon = delta.y/length(delta);
+        }
+        storeHorizon(texel, direction, horizon);
+
+        if (count == HULL_SIZE) {
+            bottom = (bottom + 1) % HULL_SIZE;
+            count--;
+        }
+        hull[(bottom + count) % HULL_SIZE] = point;
+        count++;
+    }
+}
+
+// fraction of the sky seen above the horizons, a horizon below the texel
+// hides nothing
+void occlusion(ivec2 texel) {
+    if (texel.x >= size || texel.y >= size) {
+        return;
+    }
+    float visible = 0.0;
+    for (int direction = 0; direction < DIRECTIONS; ++direction) {
+        visible += 1.0 - max(loadHorizon(texel, direction), 0.0);
+    }
+    imageStore(horizons, ivec3(texel, AO_LAYER), vec4(visible/DIRECTIONS));
+}
+
+void main() {
+    if (stage == 0) {
+        sweep(int(gl_GlobalInvocationID.x), int(gl_GlobalInvocationID.y));
+    } else {
+        occlusion(ivec2(gl_GlobalInvocationID.xy));
+    }
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include "icg_helper.h"
+#include "config.h"
+
+// Horizon angles of the heightmap in 8 directions plus the ambient occlusion
+// they give, computed on the GPU whenever the heightmap changes. The terrain
+// shades a fragment with two lookups instead of marching a shadow ray.
+// Needs compute shaders (OpenGL 4.3), IsAvailable() is false without.
+class HorizonMap {
+
+    public:
+        static const int DIRECTIONS = 8;
+        static const int LAYERS = DIRECTIONS + 1;       // and the occlusion
+        static const int GROUP_SIZE = 64;               // local_size_x of the shader
+
+    private:
+        GLuint program_id_ = 0;
+        GLuint texture_id_ = 0;             // r8 array, one layer per direction
+        int size_ = 0;
+
+        GLint stage_id;
+        GLint size_id;
+        GLint texel_size_id;
+        GLint height_scale_id;
+
+    public:
+        void Init() {
+            program_id_ = icg_helper::LoadComputeShader("horizon_cshader.glsl");
+            if (!program_id_) {
+                cerr << "No compute shaders, the terrain is rendered without shadows" << endl;
+                return;
+            }
+            glstate::State().UseProgram(program_id_);
+            glUniform1i(glGetUniformLocation(program_id_, "heightmap"), 0 /*GL_TEXTURE0*/);
+            stage_id = glGetUniformLocation(program_id_, "stage");
+            size_id = glGetUniformLocation(program_id_, "size");
+            texel_size_id = glGetUniformLocation(program_id_, "texel_size");
+            height_scale_id = glGetUniformLocation(program_id_, "height_scale");
+            glstate::State().UseProgram(0);
+        }
+
+        bool IsAvailable() const {
+            return program_id_ != 0;
+        }
+
+        GLuint Texture() const {
+            return texture_id_;
+        }
+
+        // half the heightmap resolution, the heightmap is filtered when read
+        void Compute(GLuint heightmap_texture_id, int heightmap_size) {
+
+            if (!IsAvailable()) {
+                return;
+            }
+            TRACE_SCOPE("Horizon map");
+            allocate(std::max(heightmap_size / 2, 1));
+
+            glstate::State().UseProgram(program_id_);
+            glstate::State().BindTexture(0, GL_TEXTURE_2D, heightmap_texture_id);
+            glBindImageTexture(0, texture_id_, 0, GL_TRUE, 0, GL_READ_WRITE, GL_R8);
+            glUniform1i(size_id, size_);
+            glUniform1f(texel_size_id, WORLD_SIZE / size_);
+            glUniform1f(height_scale_id, TERRAIN_HEIGHT_MULTIPLIER);
+
+            // a line per invocation, diagonals have twice as many
+            glUniform1i(stage_id, 0);
+            glDispatchCompute((2 * size_ - 1 + GROUP_SIZE - 1) / GROUP_SIZE, DIRECTIONS, 1);
+            glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+            glUniform1i(stage_id, 1);
+            glDispatchCompute((size_ + GROUP_SIZE - 1) / GROUP_SIZE, size_, 1);
+            glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+            glBindImageTexture(0, 0, 0, GL_TRUE, 0, GL_READ_WRITE, GL_R8);
+        }
+
+        void Cleanup() {
+            glstate::State().DeleteTextures(1, &texture_id_);
+            texture_id_ = 0;
+            size_ = 0;
+            if (program_id_) {
+                glstate::State().DeleteProgram(program_id_);
+                program_id_ = 0;
+            }
+        }
+
+    private:
+        // immutable storage, reallocated when the heightmap size changes
+        void allocate(int size) {
+            if (size == size_) {
+                return;
+            }
+            glstate::State().DeleteTextures(1, &texture_id_);
+            size_ = size;
+
+            glGenTextures(1, &texture_id_);
+            glstate::State().BindTexture(0, GL_TEXTURE_2D_ARRAY, texture_id_);
+            glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_R8, size_, size_, LAYERS);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            gpumemory::Registry().Track(GL_TEXTURE, texture_id_, gpumemory::MEMORY_TEXTURES,
+                                        "Horizon map",
+                                        gpumemory::TextureBytes(GL_R8, size_, size_) * LAYERS);
+        }
+};
@@ -1,6 +1,9 @@
 #pragma once
 #include "icg_helper.h"
 #include "config.h"
+#include "textureloader.h"
+#include "horizonmap.h"
+#include "grid.h"
 #include <glm/gtc/type_ptr.hpp>
 
 class Terrain {
@@ -20,6 +23,7 @@ class Terrain {
         GLuint main_texture_id_;
         GLuint shore_texture_id_;
         GLuint grass_high_texture_id_;
+        HorizonMap horizon_map_;
 
         // Matrix
         GLint model_id;
@@ -28,11 +32,13 @@ class Terrain {
 
         // Light
         GLuint lightAngle_id;
+        GLuint shadows_id;
 
         // Others
         GLuint center_id;
         GLuint clip_id;
         GLuint snowHeight_id;
+        GLuint tessellation_scale_id;
 
         // Wireframe
         GLuint wireframe_id;
@@ -40,9 +46,12 @@ class Terrain {
 
         // important parameters
         glm::vec2 center = INITIAL_CENTER;
+        float tessellation_scale = 1.0f;
+        bool shadows = true;
+        bool horizons_valid = false;    // computed from the current heightmap
 
     public:
-        void Init(GLuint tex_id) {
+        void Init(GLuint tex_id, TextureLoader &loader) {
             // compile the shaders.
             program_id_ = icg_helper::LoadShaders("terrain_vshader.glsl",
                                                   "terrain_fshader.glsl",
@@ -52,42 +61,27 @@ class Terrain {
                 exit(EXIT_FAILURE);
             }
 
-            glUseProgram(program_id_);
+            glstate::State().UseProgram(program_id_);
 
             // vertex one vertex array
             glGenVertexArrays(1, &vertex_array_id_);
-            glBindVertexArray(vertex_array_id_);
+            glstate::State().BindVertexArray(vertex_array_id_);
 
             // pass real grid size as uniform
             GLuint world_size_id = glGetUniformLocation(program_id_, "world_size");
             glUniform1f(world_size_id, WORLD_SIZE);
 
+            // heightmap size the slopes of the normals were tuned on
+            glUniform2f(glGetUniformLocation(program_id_, "normal_reference_size"),
+                        WINDOW_WIDTH, WINDOW_HEIGHT);
+
             this->center = center;
 
             // vertex coordinates and indices
            {
                std::vector<GLfloat> vertices;
                std::vector<GLuint> indices;
-
-               float quad_resolution = 256.0;
-               float quad_size = WORLD_SIZE/quad_resolution;
-
-               // Vertex position of the quads
-               for (int i = 0; i < quad_resolution; ++i) {
-                   for (int j = 0; j < quad_resolution; ++j) {
-                       vertices.push_back(quad_size*i - WORLD_SIZE/2);
-                       vertices.push_back(quad_size*j - WORLD_SIZE/2);
-                   }
-               }
-
-               for (int i = 1; i < quad_resolution - 1; i++) {
-                   for (int j = 0; j < quad_resolution - 1; j++) {
-                       indices.push_back(i*quad_resolution + j);
-                       indices.push_back((i+1)*quad_resolution + j);
-                       indices.push_back((i+1)*quad_resolution + j + 1);
-                       indices.push_back(i*quad_resolution + j + 1);
-                   }
-               }
+               BuildPatchGrid(256, WORLD_SIZE, vertices, indices);
 
                num_indices_ = indices.size();
 
@@ -96,12 +90,18 @@ class Terrain {
                glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_object_position_);
                glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat),
                             &vertices[0], GL_STATIC_DRAW);
+               gpumemory::Registry().Track(GL_BUFFER, vertex_buffer_object_position_,
+                                           gpumemory::MEMORY_BUFFERS, "Terrain vertices",
+                                           vertices.size() * sizeof(GLfloat));
 
                // vertex indices
                glGenBuffers(1, &vertex_buffer_object_index_);
                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vertex_buffer_object_index_);
                glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint),
                             &indices[0], GL_STATIC_DRAW);
+               gpumemory::Registry().Track(GL_BUFFER, vertex_buffer_object_index_,
+                                           gpumemory::MEMORY_BUFFERS, "Terrain indices",
+                                           indices.size() * sizeof(GLuint));
 
                // position shader attribute
                GLuint loc_position = glGetAttribLocation(program_id_, "position");
@@ -113,31 +113,32 @@ class Terrain {
             // load/Assign heightmap texture
             {
                 this->texture_heightmap_id = tex_id;
-                glBindTexture(GL_TEXTURE_2D, texture_heightmap_id);
+                glstate::State().BindTexture(0, GL_TEXTURE_2D, texture_heightmap_id);
                 glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
                 glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
                 GLuint i_tex_id = glGetUniformLocation(program_id_, "tex");
                 glUniform1i(i_tex_id, 0 /*GL_TEXTURE0*/);
-
-                // cleanup
-                glBindTexture(GL_TEXTURE_2D, 0);
             }
 
             // load terrain textures
-            initTexture("rock2.tga", &sand_texture_id_, "sand_tex", GL_TEXTURE1);
-            initTexture("g1.tga", &grass_texture_id_, "grass_tex", GL_TEXTURE2);
-            initTexture("r6.tga", &rock_texture_id_, "rock_tex", GL_TEXTURE3);
-            initTexture("snow.tga", &snow_texture_id_, "snow_tex", GL_TEXTURE4);
-            initTexture("d1.tga", &main_texture_id_, "main_tex", GL_TEXTURE5);
-            initTexture("f2.tga", &shore_texture_id_, "shore_tex", GL_TEXTURE6);
-            initTexture("g5.tga", &grass_high_texture_id_, "grass_high_tex", GL_TEXTURE7);
-
+            initTexture(loader, "rock2.tga", &sand_texture_id_, "sand_tex", GL_TEXTURE1);
+            initTexture(loader, "g1.tga", &grass_texture_id_, "grass_tex", GL_TEXTURE2);
+            initTexture(loader, "r6.tga", &rock_texture_id_, "rock_tex", GL_TEXTURE3);
+            initTexture(loader, "snow.tga", &snow_texture_id_, "snow_tex", GL_TEXTURE4);
+            initTexture(loader, "d1.tga", &main_texture_id_, "main_tex", GL_TEXTURE5);
+            initTexture(loader, "f2.tga", &shore_texture_id_, "shore_tex", GL_TEXTURE6);
+            initTexture(loader, "g5.tga", &grass_high_texture_id_, "grass_high_tex", GL_TEXTURE7);
+
+            // shadows and ambient occlusion
+            glUniform1i(glGetUniformLocation(program_id_, "horizon_tex"), 8 /*GL_TEXTURE8*/);
+            horizon_map_.Init();
+            glstate::State().UseProgram(program_id_);
 
             getAllUniformLocation();
 
             // to avoid the current object being polluted
-            glBindVertexArray(0);
-            glUseProgram(0);
+            glstate::State().BindVertexArray(0);
+            glstate::State().UseProgram(0);
 
         }
 
@@ -149,27 +150,64 @@ class Terrain {
             wireframe = value;
         }
 
+        // the heightmap framebuffer is recreated when its size changes
+        void setHeightmapTexture(GLuint tex_id) {
+            texture_heightmap_id = tex_id;
+            horizons_valid = false;
+        }
+
+        // sun shadows and ambient occlusion from the horizon map
+        void setShadows(bool value) {
+            shadows = value;
+        }
+
+        bool ShadowsAvailable() const {
+            return horizon_map_.IsAvailable();
+        }
+
+        // after each change of the heightmap, skipped while shadows are off
+        void HeightmapChanged(int heightmap_size) {
+            horizons_valid = false;
+            if (shadows) {
+                horizon_map_.Compute(texture_heightmap_id, heightmap_size);
+                horizons_valid = horizon_map_.IsAvailable();
+            }
+        }
+
+        bool HorizonsValid() const {
+            return horizons_valid;
+        }
+
+        // multiplies the distance based tessellation levels
+        void setTessellationScale(float value) {
+            tessellation_scale = value;
+        }
+
         void Cleanup() {
-            glBindVertexArray(0);
-            glUseProgram(0);
+            glstate::State().BindVertexArray(0);
+            glstate::State().UseProgram(0);
             glDeleteBuffers(1, &vertex_buffer_object_position_);
-            glDeleteVertexArrays(1, &vertex_array_id_);
-            glDeleteProgram(program_id_);
-            glDeleteTextures(1, &sand_texture_id_);
-            glDeleteTextures(1, &rock_texture_id_);
-            glDeleteTextures(1, &grass_texture_id_);
-            glDeleteTextures(1, &snow_texture_id_);
-            glDeleteTextures(1, &main_texture_id_);
-            glDeleteTextures(1, &texture_heightmap_id);
-            glDeleteTextures(1, &shore_texture_id_);
-            glDeleteTextures(1, &grass_high_texture_id_);
+            glDeleteBuffers(1, &vertex_buffer_object_index_);
+            gpumemory::Registry().Release(GL_BUFFER, vertex_buffer_object_position_);
+            gpumemory::Registry().Release(GL_BUFFER, vertex_buffer_object_index_);
+            glstate::State().DeleteVertexArrays(1, &vertex_array_id_);
+            glstate::State().DeleteProgram(program_id_);
+            glstate::State().DeleteTextures(1, &sand_texture_id_);
+            glstate::State().DeleteTextures(1, &rock_texture_id_);
+            glstate::State().DeleteTextures(1, &grass_texture_id_);
+            glstate::State().DeleteTextures(1, &snow_texture_id_);
+            glstate::State().DeleteTextures(1, &main_texture_id_);
+            glstate::State().DeleteTextures(1, &texture_heightmap_id);
+            glstate::State().DeleteTextures(1, &shore_texture_id_);
+            glstate::State().DeleteTextures(1, &grass_high_texture_id_);
+            horizon_map_.Cleanup();
         }
 
         void Draw(const glm::mat4 &model, const glm::mat4 &view, const glm::mat4 &projection,
                   int clip, float lightAngle, float snowHeight) {
 
-            glUseProgram(program_id_);
-            glBindVertexArray(vertex_array_id_);
+            glstate::State().UseProgram(program_id_);
+            glstate::State().BindVertexArray(vertex_array_id_);
 
             bindAllTexture();
 
@@ -180,6 +218,7 @@ class Terrain {
 
             // Light
             glUniform1f(lightAngle_id, lightAngle);
+            glUniform1i(shadows_id, shadows && horizons_valid);
 
             // Wireframe
             glUniform1i(wireframe_id, wireframe);
@@ -188,55 +227,22 @@ class Terrain {
             glUniform2fv(center_id, 1, &center[0]);
             glUniform1i(clip_id, clip);
             glUniform1f(snowHeight_id, snowHeight);
+            glUniform1f(tessellation_scale_id, tessellation_scale);
 
             // Draw
             glPatchParameteri(GL_PATCH_VERTICES, 4);
             //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
             glDrawElements(GL_PATCHES, num_indices_, GL_UNSIGNED_INT, 0);
-
-            glBindVertexArray(0);
-            glUseProgram(0);
-
         }
 
-        void initTexture(string filename, GLuint *texture_id, string texture_name, int val) {
-
-            int width;
-            int height;
-            int nb_component;
-
-            //set stb_image to have the same coordinates as OpenGl
-            stbi_set_flip_vertically_on_load(1);
-            unsigned char *image = stbi_load(filename.c_str(), &width, &height, &nb_component, 0);
-
-            if (image == nullptr) {
-                throw(string("Failed to load texture"));
-            }
-
-            glGenTextures(1, texture_id);
-            glBindTexture(GL_TEXTURE_2D, *texture_id);
-
-            if (nb_component == 3) {
-                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-            } else if (nb_component == 4) {
-                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-            }
-
-
-            glGenerateMipmap(GL_TEXTURE_2D);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        void initTexture(TextureLoader &loader, string filename, GLuint *texture_id,
+                         string texture_name, int val) {
 
+            // decoded asynchronously, mipmaps are generated after the upload
+            *texture_id = loader.Load(filename, true);
 
             GLuint tex_id = glGetUniformLocation(program_id_, texture_name.c_str());
-            //glUseProgram(program_id_);
             glUniform1i(tex_id, val - GL_TEXTURE0);
-
-            // cleanup
-            glBindTexture(GL_TEXTURE_2D, val);
-            stbi_image_free(image);
         }
 
 
@@ -249,6 +255,7 @@ class Terrain {
 
             // Light
             lightAngle_id = glGetUniformLocation(program_id_, "lightAngle");
+            shadows_id = glGetUniformLocation(program_id_, "shadows");
 
             // Wireframe
             wireframe_id = glGetUniformLocation(program_id_, "wireframe");
@@ -257,31 +264,19 @@ class Terrain {
             center_id = glGetUniformLocation(program_id_, "center");
             clip_id = glGetUniformLocation(program_id_, "clip");
             snowHeight_id = glGetUniformLocation(program_id_, "snowHeight");
+            tessellation_scale_id = glGetUniformLocation(program_id_, "tessellation_scale");
         }
 
         void bindAllTexture() {
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, texture_heightmap_id);
-
-            glActiveTexture(GL_TEXTURE1);
-            glBindTexture(GL_TEXTURE_2D, sand_texture_id_);
-
-            glActiveTexture(GL_TEXTURE2);
-            glBindTexture(GL_TEXTURE_2D, grass_texture_id_);
-
-            glActiveTexture(GL_TEXTURE3);
-            glBindTexture(GL_TEXTURE_2D, rock_texture_id_);
-
-            glActiveTexture(GL_TEXTURE4);
-            glBindTexture(GL_TEXTURE_2D, snow_texture_id_);
-
-            glActiveTexture(GL_TEXTURE5);
-            glBindTexture(GL_TEXTURE_2D, main_texture_id_);
-
-            glActiveTexture(GL_TEXTURE6);
-            glBindTexture(GL_TEXTURE_2D, shore_texture_id_);
-
-            glActiveTexture(GL_TEXTURE7);
-            glBindTexture(GL_TEXTURE_2D, grass_high_texture_id_);
+            glstate::StateCache &state = glstate::State();
+            state.BindTexture(0, GL_TEXTURE_2D, texture_heightmap_id);
+            state.BindTexture(1, GL_TEXTURE_2D, sand_texture_id_);
+            state.BindTexture(2, GL_TEXTURE_2D, grass_texture_id_);
+            state.BindTexture(3, GL_TEXTURE_2D, rock_texture_id_);
+            state.BindTexture(4, GL_TEXTURE_2D, snow_texture_id_);
+            state.BindTexture(5, GL_TEXTURE_2D, main_texture_id_);
+            state.BindTexture(6, GL_TEXTURE_2D, shore_texture_id_);
+            state.BindTexture(7, GL_TEXTURE_2D, grass_high_texture_id_);
+            state.BindTexture(8, GL_TEXTURE_2D_ARRAY, horizon_map_.Texture());
         }
 };
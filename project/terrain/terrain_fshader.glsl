@@ -20,12 +20,36 @@ uniform sampler2D snow_tex;
 uniform sampler2D tex;
 uniform sampler2D shore_tex;
 uniform sampler2D grass_high_tex;
+uniform sampler2DArray horizon_tex;
 uniform bool wireframe;
+uniform bool shadows;
 
 // uniforms
 uniform vec2 center;
 uniform float snowHeight;
 uniform float lightAngle;
+uniform vec2 normal_reference_size;     // heightmap size the normal slopes were tuned on
+
+const float PI = 3.14159265;
+const float AMBIENT = 0.2;              // of the light, scaled by the occlusion
+const float PENUMBRA = 0.03;            // sun elevation sine over which shadows fade
+
+// 0 when the sun is below the horizon of the texel, the horizon towards the
+// sun azimuth is interpolated between the 8 directions of the horizon map
+float sunVisibility(vec3 light) {
+    // u follows x and v follows -z
+    float direction = mod(atan(-light.z, light.x)/(PI/4.0), 8.0);
+    float layer0 = floor(direction);
+    float layer1 = mod(layer0 + 1.0, 8.0);
+    float horizon = mix(texture(horizon_tex, vec3(uv, layer0)).r,
+                        texture(horizon_tex, vec3(uv, layer1)).r,
+                        direction - layer0)*2.0 - 1.0;
+    return smoothstep(horizon - PENUMBRA, horizon + PENUMBRA, light.y);
+}
+
+float ambientOcclusion() {
+    return texture(horizon_tex, vec3(uv, 8.0)).r;
+}
 
 // compute normal using finite differences
 vec3 computeNormal() {
@@ -36,10 +60,11 @@ vec3 computeNormal() {
     float hD = textureOffset(tex, uv, ivec2(0, -1)).r;
     float hU = textureOffset(tex, uv, ivec2(0, 1)).r;
 
-    // deduce terrain normal
+    // deduce terrain normal, scaled to the heightmap size the slopes were tuned on
+    vec2 texel_scale = vec2(textureSize(tex, 0)) / normal_reference_size;
     vec3 normal;
-    normal.x = hL - hR;
-    normal.z = hD - hU;
+    normal.x = (hL - hR)*texel_scale.x;
+    normal.z = (hD - hU)*texel_scale.y;
     normal.y = 0.03;
     return normalize(normal);
 }
@@ -173,6 +198,10 @@ void main() {
     vec3 light_color = vec3(1.0, bg, bg);
 
     vec3 diffuse = baseColor*max(dot(normal, light_dir), 0)*light_color;
+    if (shadows) {
+        float direct = max(dot(normal, light_dir), 0)*sunVisibility(light_dir);
+        diffuse = baseColor*light_color*(direct*(1.0 - AMBIENT) + AMBIENT*ambientOcclusion());
+    }
 
     float dist = sqrt(pos3d.x*pos3d.x + pos3d.z*pos3d.z);
     float fogFactor = (dist - 200)/50.0;
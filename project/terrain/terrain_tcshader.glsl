@@ -12,6 +12,9 @@ uniform mat4 projection;
 uniform mat4 model;
 uniform mat4 view;
 
+// set by the triangle budget governor, 1 keeps the levels below
+uniform float tessellation_scale;
+
 float smootherstep(float edge0, float edge1, float x)
 {
     // Scale, bias and saturate x to 0..1 range
@@ -39,7 +42,7 @@ float clamp(float x, float lowerlimit, float upperlimit)
     return x;
 }
 
-int outerTessellationFunction(vec4 vertex1, vec4 vertex2, vec4 camera) {
+float baseTessellationLevel(vec4 vertex1, vec4 vertex2, vec4 camera) {
 
     //Bring vertexes to world coordinates
     vec4 v1 = projection*view*model*vertex1;
@@ -51,17 +54,17 @@ int outerTessellationFunction(vec4 vertex1, vec4 vertex2, vec4 camera) {
     float edgeDistance = (norm1 + norm2)/2.0;
 
     if(edgeDistance < 10) {
-        return 8;
+        return 8.0;
     } else if (edgeDistance < 25){
-        return 7;
+        return 7.0;
     } else if (edgeDistance < 100){
-        return 6;
+        return 6.0;
     } else if (edgeDistance < 150){
-        return 5;
+        return 5.0;
     } else if (edgeDistance < 250){
-        return 4;
+        return 4.0;
     } else {
-        return 3;
+        return 3.0;
     }
 /*
     if(edgeDistance < 150) {
@@ -75,15 +78,20 @@ int outerTessellationFunction(vec4 vertex1, vec4 vertex2, vec4 camera) {
 
 }
 
+float outerTessellationFunction(vec4 vertex1, vec4 vertex2, vec4 camera) {
+    return max(1.0, baseTessellationLevel(vertex1, vertex2, camera)*tessellation_scale);
+}
+
 void main(void){
     if (gl_InvocationID == 0){
 
-        int outer0 = outerTessellationFunction(vVertexOut[0], vVertexOut[3], vec4(0, 0, 0, 1));
-        int outer1 = outerTessellationFunction(vVertexOut[2], vVertexOut[3], vec4(0, 0, 0, 1));
-        int outer2 = outerTessellationFunction(vVertexOut[1], vVertexOut[2], vec4(0, 0, 0, 1));
-        int outer3 = outerTessellationFunction(vVertexOut[0], vVertexOut[1], vec4(0, 0, 0, 1));
+        float outer0 = outerTessellationFunction(vVertexOut[0], vVertexOut[3], vec4(0, 0, 0, 1));
+        float outer1 = outerTessellationFunction(vVertexOut[2], vVertexOut[3], vec4(0, 0, 0, 1));
+        float outer2 = outerTessellationFunction(vVertexOut[1], vVertexOut[2], vec4(0, 0, 0, 1));
+        float outer3 = outerTessellationFunction(vVertexOut[0], vVertexOut[1], vec4(0, 0, 0, 1));
 
-        int inner = (outer0 + outer1 + outer2 + outer3)/4;
+        // truncated like the former integer average
+        float inner = max(1.0, floor((outer0 + outer1 + outer2 + outer3)/4.0));
 
         gl_TessLevelInner[0] = inner;
         gl_TessLevelInner[1] = inner;
@@ -93,10 +101,11 @@ void main(void){
         gl_TessLevelOuter[2] = outer2;
         gl_TessLevelOuter[3] = outer3;
 
-        tVertexCount[0] = outer0;
-        tVertexCount[1] = outer1;
-        tVertexCount[2] = outer2;
-        tVertexCount[3] = outer3;
+        // equal_spacing rounds the levels up
+        tVertexCount[0] = int(ceil(outer0));
+        tVertexCount[1] = int(ceil(outer1));
+        tVertexCount[2] = int(ceil(outer2));
+        tVertexCount[3] = int(ceil(outer3));
 
     }
 
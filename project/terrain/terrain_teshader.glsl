@@ -50,8 +50,9 @@ void main(void){
     vec4 vpoint_mv = MV * pos3d;
     gl_Position = projection * vpoint_mv;
 
-    // compute light direction and view direction for shading purposes
-    light_dir = normalize(vec4(250*cos(lightAngle),250*sin(lightAngle), 50.0, 0.0) - vec4(vpoint_mv.xyz, 0.0)).xyz;
+    // compute light direction and view direction for shading purposes, the
+    // light is in world space like the normals and the horizon map
+    light_dir = normalize(vec3(250*cos(lightAngle), 250*sin(lightAngle), 50.0) - (model * pos3d).xyz);
     view_dir = normalize(vec4(0.0, 0.0, 0.0, 0.0) - vpoint_mv).xyz;
 
 }
@@ -0,0 +1,255 @@
+#pragma once
+#include "icg_helper.h"
+#include "asset_archive.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
+// Uploads textures found in the packed asset archive directly from its
+// mapping, with their prebuilt mip chains. Any other image file is decoded
+// on a worker thread and uploaded through a pixel buffer object as soon as
+// it is ready; until then the texture holds a 1x1 placeholder, so it can be
+// bound and sampled right away.
+class TextureLoader {
+
+    private:
+        struct Job {
+            string filename;
+            GLuint texture_id;
+            bool mipmap;
+            unsigned char *image;
+            int width;
+            int height;
+            int nb_component;
+        };
+
+        std::vector<std::thread> workers_;
+        std::mutex mutex_;
+        std::condition_variable condition_;
+        std::deque<Job> pending_;       // waiting for a worker
+        std::deque<Job> decoded_;       // waiting for the upload
+        bool stop_ = false;
+        int in_flight_ = 0;             // requested but not uploaded yet
+
+        GLuint pixel_buffer_id_ = 0;
+
+        AssetArchive archive_;
+
+    public:
+        void Init(const char *archive_path = "assets.pack", int num_threads = 0) {
+
+            // loose files are still used when there is no archive
+            if (archive_.Open(archive_path)) {
+                cout << "Using asset archive " << archive_path << endl;
+            }
+
+            if (num_threads <= 0) {
+                num_threads = std::thread::hardware_concurrency();
+                num_threads = num_threads < 1 ? 1 : (num_threads > 4 ? 4 : num_threads);
+            }
+
+            // the flag is global in stb_image, so it is set before any worker starts
+            stbi_set_flip_vertically_on_load(1);
+
+            glGenBuffers(1, &pixel_buffer_id_);
+
+            stop_ = false;
+            for (int i = 0; i < num_threads; ++i) {
+                workers_.push_back(std::thread(&TextureLoader::workerLoop, this));
+            }
+        }
+
+        // Returns a texture holding the placeholder color; the image replaces it
+        // in a later call to Update()
+        GLuint Load(const string &filename, bool mipmap,
+                    glm::u8vec3 placeholder = glm::u8vec3(128, 128, 128)) {
+
+            GLuint texture_id;
+            glGenTextures(1, &texture_id);
+            glstate::State().BindTexture(0, GL_TEXTURE_2D, texture_id);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, &placeholder[0]);
+            gpumemory::Registry().Track(GL_TEXTURE, texture_id, gpumemory::MEMORY_TEXTURES,
+                                        filename, gpumemory::TextureBytes(GL_RGB, 1, 1));
+
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                            mipmap ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+
+            const AssetArchiveEntry *entry = archive_.Find(filename);
+            if (entry != nullptr) {
+                uploadFromArchive(*entry, texture_id, mipmap);
+                return texture_id;
+            }
+
+            Job job;
+            job.filename = filename;
+            job.texture_id = texture_id;
+            job.mipmap = mipmap;
+            job.image = nullptr;
+            job.width = job.height = job.nb_component = 0;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                pending_.push_back(job);
+                in_flight_++;
+            }
+            condition_.notify_one();
+
+            return texture_id;
+        }
+
+        // Uploads every image decoded so far, must be called from the GL thread
+        void Update() {
+
+            std::deque<Job> ready;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (decoded_.empty()) {
+                    return;
+                }
+                ready.swap(decoded_);
+            }
+
+            for (size_t i = 0; i < ready.size(); ++i) {
+                upload(ready[i]);
+            }
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            in_flight_ -= ready.size();
+        }
+
+        // true once every requested texture has been uploaded
+        bool IsIdle() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return in_flight_ == 0;
+        }
+
+        void Cleanup() {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stop_ = true;
+            }
+            condition_.notify_all();
+            for (size_t i = 0; i < workers_.size(); ++i) {
+                workers_[i].join();
+            }
+            workers_.clear();
+
+            for (size_t i = 0; i < decoded_.size(); ++i) {
+                stbi_image_free(decoded_[i].image);
+            }
+            decoded_.clear();
+            pending_.clear();
+
+            glDeleteBuffers(1, &pixel_buffer_id_);
+            gpumemory::Registry().Release(GL_BUFFER, pixel_buffer_id_);
+            archive_.Close();
+        }
+
+    private:
+        void workerLoop() {
+
+            trace::SetThreadName("Texture decoder");
+            while (true) {
+                Job job;
+                {
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    condition_.wait(lock, [this] { return stop_ || !pending_.empty(); });
+                    if (stop_) {
+                        return;
+                    }
+                    job = pending_.front();
+                    pending_.pop_front();
+                }
+
+                TRACE_SCOPE_DETAIL("Decode texture", job.filename.c_str());
+                job.image = stbi_load(job.filename.c_str(), &job.width, &job.height,
+                                      &job.nb_component, 0);
+
+                std::lock_guard<std::mutex> lock(mutex_);
+                decoded_.push_back(job);
+            }
+        }
+
+        // uploads into the texture bound to GL_TEXTURE_2D
+        void uploadFromArchive(const AssetArchiveEntry &entry, GLuint texture_id, bool mipmap) {
+
+            TRACE_SCOPE_DETAIL("Upload from archive", entry.name);
+
+            GLenum format = entry.format == ASSET_FORMAT_RGBA8 ? GL_RGBA : GL_RGB;
+            GLuint num_levels = mipmap ? entry.num_levels : 1;
+
+            size_t bytes = 0;
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            for (GLuint level = 0; level < num_levels; ++level) {
+                const AssetArchiveLevel &data = entry.levels[level];
+                glTexImage2D(GL_TEXTURE_2D, level, format, data.width, data.height, 0,
+                             format, GL_UNSIGNED_BYTE, archive_.LevelData(data));
+                bytes += gpumemory::TextureBytes(format, data.width, data.height);
+            }
+            gpumemory::Registry().Track(GL_TEXTURE, texture_id, gpumemory::MEMORY_TEXTURES,
+                                        entry.name, bytes);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, num_levels - 1);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        }
+
+        void upload(Job &job) {
+
+            TRACE_SCOPE_DETAIL("Upload texture", job.filename.c_str());
+
+            // a missing image keeps its placeholder
+            if (job.image == nullptr) {
+                cerr << "Failed to load texture: " << job.filename << endl;
+                return;
+            }
+
+            GLenum format;
+            if (job.nb_component == 3) {
+                format = GL_RGB;
+            } else if (job.nb_component == 4) {
+                format = GL_RGBA;
+            } else {
+                cerr << "Unsupported texture format: " << job.filename << endl;
+                stbi_image_free(job.image);
+                return;
+            }
+
+            // orphan the previous storage so the copy never waits on the last upload
+            GLsizeiptr size = (GLsizeiptr) job.width * job.height * job.nb_component;
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixel_buffer_id_);
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+            gpumemory::Registry().Track(GL_BUFFER, pixel_buffer_id_, gpumemory::MEMORY_BUFFERS,
+                                        "Texture upload staging", size);
+            void *mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+                                            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+            if (mapped != nullptr) {
+                memcpy(mapped, job.image, size);
+                glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            }
+
+            // rows of RGB images are not 4 byte aligned in general
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            glstate::State().BindTexture(0, GL_TEXTURE_2D, job.texture_id);
+            if (mapped != nullptr) {
+                glTexImage2D(GL_TEXTURE_2D, 0, format, job.width, job.height, 0,
+                             format, GL_UNSIGNED_BYTE, ZERO_BUFFER_OFFSET);
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            } else {
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                glTexImage2D(GL_TEXTURE_2D, 0, format, job.width, job.height, 0,
+                             format, GL_UNSIGNED_BYTE, job.image);
+            }
+            if (job.mipmap) {
+                glGenerateMipmap(GL_TEXTURE_2D);
+            }
+            gpumemory::Registry().Track(GL_TEXTURE, job.texture_id, gpumemory::MEMORY_TEXTURES,
+                                        job.filename, gpumemory::TextureBytes(format, job.width,
+                                                                              job.height, job.mipmap));
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+            stbi_image_free(job.image);
+        }
+};
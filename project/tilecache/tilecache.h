@@ -0,0 +1,482 @@
+#pragma once
+#include "icg_helper.h"
+#include "config.h"
+#include "framebuffer.h"
+#include "screenquad/screenquad.h"
+#include "tilescheduler.h"
+
+#include <algorithm>
+#include <list>
+#include <map>
+
+// The noise plane is cut in tiles of 1/TILES_PER_VIEW heightmap, generated
+// once into the pages of a texture array and kept there until they are the
+// least recently used of the pool. The heightmap around the center is then
+// assembled from the pages, so flying back over an area doesn't evaluate
+// the noise again and the memory stays bounded however far the camera goes.
+//
+// The tiles around the view are generated ahead of time on the CPU by a
+// TileScheduler, those the camera heads to first. A tile that enters the
+// view before its worker is done is rendered on the GPU right away. The
+// views a TilePrefetcher predicts are requested before the margin. Tiles
+// baked into a TileStore with the same noise are read from it instead.
+//
+//     tile_cache.Resize(heightmap.Width());
+//     tile_cache.Update(center, heading, prefetcher.Centers(), screenquad, heightmap);
+class TileCache {
+
+    public:
+        static const int INDIRECTION_SIZE = 8;      // tiles per side, covers the view
+        static_assert(INDIRECTION_SIZE >= TILES_PER_VIEW + 1, "indirection smaller than the view");
+        static const int PREFETCH_MARGIN = 1;       // tiles around the view
+        static_assert(TILE_CACHE_PAGES >= (TILES_PER_VIEW + 1 + 2 * PREFETCH_MARGIN) *
+                                          (TILES_PER_VIEW + 1 + 2 * PREFETCH_MARGIN),
+                      "the prefetched pages would evict the view");
+
+    private:
+        struct Page {
+            TileKey key;
+            bool valid;
+            int kept_in;                    // last update that wanted the tile, in view or ahead
+            std::list<int>::iterator lru;
+        };
+
+        GLuint program_id_;
+        GLuint vertex_array_id_;
+        GLuint framebuffer_id_;
+        GLuint pages_texture_id_ = 0;
+        GLuint indirection_texture_id_;
+
+        int heightmap_size_ = 0;
+        int page_texels_ = 0;               // per tile side, without the border
+        int noise_version_ = -1;
+
+        vector<Page> pages_;
+        std::list<int> lru_;                // most recent first
+        std::map<TileKey, int> resident_;
+        TileScheduler scheduler_;
+        int update_ = 0;
+
+        TileStore store_;
+        bool use_store_ = false;            // baked with the current noise and page size
+
+        int generated_ = 0;                 // on the GPU during the last update
+        int total_generated_ = 0;
+        int total_streamed_ = 0;            // from the workers
+        int total_loaded_ = 0;              // from the store on the render thread
+        vector<float> loaded_heights_;
+
+        GLint center_id_;
+        GLint texel_size_id_;
+        GLint page_texels_id_;
+        GLint first_tile_id_;
+
+    public:
+        void Init(const char *store_path = "terrain.tiles") {
+
+            if (store_.Open(store_path)) {
+                const TileStoreHeader &header = store_.Header();
+                printf("Using tile store %s: %ux%u tiles of %u texels\n", store_path,
+                       header.width, header.height, header.page_texels);
+            }
+
+            program_id_ = icg_helper::LoadShaders("tilecache_vshader.glsl",
+                                                  "tilecache_fshader.glsl",
+                                                  NULL, NULL);
+            if (!program_id_) {
+                exit(EXIT_FAILURE);
+            }
+            glstate::State().UseProgram(program_id_);
+            glUniform1i(glGetUniformLocation(program_id_, "pages"), 0 /*GL_TEXTURE0*/);
+            glUniform1i(glGetUniformLocation(program_id_, "indirection"), 1 /*GL_TEXTURE1*/);
+            center_id_ = glGetUniformLocation(program_id_, "center");
+            texel_size_id_ = glGetUniformLocation(program_id_, "texel_size");
+            page_texels_id_ = glGetUniformLocation(program_id_, "page_texels");
+            first_tile_id_ = glGetUniformLocation(program_id_, "first_tile");
+            glstate::State().UseProgram(0);
+
+            // the composite draws a triangle without attributes
+            glGenVertexArrays(1, &vertex_array_id_);
+            glGenFramebuffers(1, &framebuffer_id_);
+
+            glGenTextures(1, &indirection_texture_id_);
+            glstate::State().BindTexture(0, GL_TEXTURE_2D, indirection_texture_id_);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_R16UI, INDIRECTION_SIZE, INDIRECTION_SIZE, 0,
+                         GL_RED_INTEGER, GL_UNSIGNED_SHORT, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            gpumemory::Registry().Track(GL_TEXTURE, indirection_texture_id_,
+                                        gpumemory::MEMORY_TEXTURES, "Tile indirection",
+                                        INDIRECTION_SIZE * INDIRECTION_SIZE * 2);
+
+            scheduler_.Start();
+        }
+
+        // the page size follows the heightmap resolution, the cached tiles
+        // are dropped when it changes
+        void Resize(int heightmap_size) {
+            if (heightmap_size == heightmap_size_) {
+                return;
+            }
+            heightmap_size_ = heightmap_size;
+            page_texels_ = std::max(heightmap_size / TILES_PER_VIEW, 1);
+
+            glstate::State().DeleteTextures(1, &pages_texture_id_);
+            int page_size = page_texels_ + 2;
+            glGenTextures(1, &pages_texture_id_);
+            glstate::State().BindTexture(0, GL_TEXTURE_2D_ARRAY, pages_texture_id_);
+            glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_R32F, page_size, page_size, TILE_CACHE_PAGES);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            gpumemory::Registry().Track(GL_TEXTURE, pages_texture_id_, gpumemory::MEMORY_TEXTURES,
+                                        "Tile pages",
+                                        gpumemory::TextureBytes(GL_R32F, page_size, page_size) *
+                                        TILE_CACHE_PAGES);
+
+            Clear();
+
+            // matched with the store again on the next update
+            noise_version_ = -1;
+        }
+
+        // forgets every tile, e.g. when the noise parameters change
+        void Clear() {
+            scheduler_.CancelAll();
+            use_store_ = false;
+            pages_.assign(TILE_CACHE_PAGES, Page());
+            lru_.clear();
+            resident_.clear();
+            for (int page = 0; page < TILE_CACHE_PAGES; ++page) {
+                pages_[page].valid = false;
+                pages_[page].kept_in = -1;
+                pages_[page].lru = lru_.insert(lru_.end(), page);
+            }
+        }
+
+        // renders the heightmap of the unit square at center, generating the
+        // tiles it covers that aren't resident. heading is the direction of
+        // the camera in the noise plane, predicted the centers it will have
+        // next, soonest first
+        void Update(glm::vec2 center, glm::vec2 heading, const vector<glm::vec2> &predicted,
+                    ScreenQuad &noise, FrameBuffer &heightmap) {
+
+            TRACE_SCOPE("Tile cache");
+            if (noise.Version() != noise_version_) {
+                noise_version_ = noise.Version();
+                Clear();
+                use_store_ = storeMatches(noise.Parameters());
+            }
+            update_++;
+
+            scheduler_.Collect([&](const TileKey &key, const float *heights) {
+                upload(key, heights);
+            });
+
+            double texel_size = 1.0 / heightmap_size_;
+            TileKey first, last;
+            viewTiles(center, first, last);
+
+            generated_ = 0;
+            GLushort indirection[INDIRECTION_SIZE * INDIRECTION_SIZE] = { 0 };
+            for (int y = first.y; y <= last.y && y - first.y < INDIRECTION_SIZE; ++y) {
+                for (int x = first.x; x <= last.x && x - first.x < INDIRECTION_SIZE; ++x) {
+                    TileKey key = { x, y };
+                    indirection[(y - first.y) * INDIRECTION_SIZE + (x - first.x)] =
+                        acquire(key, noise);
+                }
+            }
+            schedule(first, last, center, heading, predicted, noise.Parameters());
+
+            glstate::State().BindTexture(1, GL_TEXTURE_2D, indirection_texture_id_);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, INDIRECTION_SIZE, INDIRECTION_SIZE,
+                            GL_RED_INTEGER, GL_UNSIGNED_SHORT, indirection);
+
+            // composite
+            heightmap.Bind();
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            glstate::State().UseProgram(program_id_);
+            glstate::State().BindVertexArray(vertex_array_id_);
+            glstate::State().BindTexture(0, GL_TEXTURE_2D_ARRAY, pages_texture_id_);
+            glUniform2fv(center_id_, 1, &center[0]);
+            glUniform1f(texel_size_id_, texel_size);
+            glUniform1i(page_texels_id_, page_texels_);
+            glUniform2i(first_tile_id_, first.x, first.y);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            heightmap.Unbind();
+        }
+
+        int ResidentTiles() const {
+            return resident_.size();
+        }
+
+        // during the last update
+        int GeneratedTiles() const {
+            return generated_;
+        }
+
+        int TotalGeneratedTiles() const {
+            return total_generated_;
+        }
+
+        int TotalStreamedTiles() const {
+            return total_streamed_;
+        }
+
+        int TotalLoadedTiles() const {
+            return total_loaded_;
+        }
+
+        bool UsesStore() const {
+            return use_store_;
+        }
+
+        const TileScheduler& Scheduler() const {
+            return scheduler_;
+        }
+
+        void Cleanup() {
+            scheduler_.Stop();
+            store_.Close();
+            glstate::State().DeleteTextures(1, &pages_texture_id_);
+            glstate::State().DeleteTextures(1, &indirection_texture_id_);
+            glstate::State().DeleteFramebuffers(1, &framebuffer_id_);
+            glstate::State().DeleteVertexArrays(1, &vertex_array_id_);
+            glstate::State().DeleteProgram(program_id_);
+            heightmap_size_ = 0;
+        }
+
+    private:
+        // tiles under the first and last heightmap texels of the view at center
+        void viewTiles(glm::vec2 center, TileKey &first, TileKey &last) const {
+            double texel_size = 1.0 / heightmap_size_;
+            first = tileOf(center.x / texel_size, center.y / texel_size);
+            last = tileOf((center.x + 1.0) / texel_size - 1.0, (center.y + 1.0) / texel_size - 1.0);
+        }
+
+        // tile containing the given heightmap texel of the noise plane
+        TileKey tileOf(double texel_x, double texel_y) const {
+            TileKey key = { (int) floor(floor(texel_x) / page_texels_),
+                            (int) floor(floor(texel_y) / page_texels_) };
+            return key;
+        }
+
+        // page of the tile, the least recently used page is reused for a
+        // tile that isn't resident
+        int acquire(const TileKey &key, ScreenQuad &noise) {
+            std::map<TileKey, int>::iterator found = resident_.find(key);
+            int page;
+            if (found != resident_.end()) {
+                page = found->second;
+            } else {
+                // needed now, a worker would be too late
+                scheduler_.Cancel(key);
+                page = evict();
+                if (!load(key, page)) {
+                    generate(key, page, noise);
+                }
+                pages_[page].key = key;
+                pages_[page].valid = true;
+                resident_[key] = page;
+            }
+            pages_[page].kept_in = update_;
+            lru_.splice(lru_.begin(), lru_, pages_[page].lru);
+            return page;
+        }
+
+        // the least recently used page, emptied
+        int evict() {
+            int page = lru_.back();
+            if (pages_[page].valid) {
+                resident_.erase(pages_[page].key);
+                pages_[page].valid = false;
+            }
+            return page;
+        }
+
+        // the tiles around the view and in the predicted views that aren't
+        // resident. Around the view they go by screen-space importance: a
+        // tile ahead of the camera enters the view sooner and covers more of
+        // it than one at the same distance on the side. The predicted views
+        // come first, the sooner the earlier, as long as their tiles fit in
+        // the cache with the view. The tiles no longer wanted are cancelled
+        void schedule(const TileKey &first, const TileKey &last, glm::vec2 center,
+                      glm::vec2 heading, const vector<glm::vec2> &predicted,
+                      const NoiseParameters &parameters) {
+
+            double texel_size = 1.0 / heightmap_size_;
+            float tile_size = page_texels_ * texel_size;
+            glm::vec2 eye = center + glm::vec2(0.5f);   // over the middle of the heightmap
+            if (glm::length(heading) > 0.0f) {
+                heading = glm::normalize(heading);
+            }
+
+            // the resident tiles wanted are kept like those of the view,
+            // the others requested
+            int kept = (last.x - first.x + 1) * (last.y - first.y + 1);
+            std::map<TileKey, float> wanted;
+            for (int y = first.y - PREFETCH_MARGIN; y <= last.y + PREFETCH_MARGIN; ++y) {
+                for (int x = first.x - PREFETCH_MARGIN; x <= last.x + PREFETCH_MARGIN; ++x) {
+                    TileKey key = { x, y };
+                    bool in_view = x >= first.x && x <= last.x && y >= first.y && y <= last.y;
+                    if (in_view || keep(key, kept)) {
+                        continue;
+                    }
+                    glm::vec2 to_tile = (glm::vec2(x, y) + 0.5f) * tile_size - eye;
+                    float distance = glm::length(to_tile) / tile_size;
+                    float facing = glm::dot(glm::normalize(to_tile), heading);
+                    wanted[key] = distance / (0.25f + 0.75f * std::max(facing, 0.0f));
+                }
+            }
+
+            // the margin is at least 2.5 tiles from the eye, so the predicted
+            // views get priorities below that. A view is only wanted if all
+            // the wanted tiles still fit in the cache
+            for (size_t i = 0; i < predicted.size(); ++i) {
+                float priority = 0.5f + 2.0f * i / predicted.size();
+                TileKey predicted_first, predicted_last;
+                viewTiles(predicted[i], predicted_first, predicted_last);
+
+                vector<TileKey> added;
+                vector<TileKey> resident;
+                for (int y = predicted_first.y; y <= predicted_last.y; ++y) {
+                    for (int x = predicted_first.x; x <= predicted_last.x; ++x) {
+                        TileKey key = { x, y };
+                        std::map<TileKey, int>::iterator page = resident_.find(key);
+                        if (page != resident_.end()) {
+                            if (pages_[page->second].kept_in != update_) {
+                                resident.push_back(key);
+                            }
+                            continue;
+                        }
+                        std::map<TileKey, float>::iterator found = wanted.find(key);
+                        if (found != wanted.end()) {
+                            found->second = std::min(found->second, priority);
+                        } else {
+                            added.push_back(key);
+                        }
+                    }
+                }
+                if (kept + (int) (resident.size() + wanted.size() + added.size()) > TILE_CACHE_PAGES) {
+                    break;
+                }
+                for (size_t k = 0; k < resident.size(); ++k) {
+                    keep(resident[k], kept);
+                }
+                for (size_t k = 0; k < added.size(); ++k) {
+                    wanted[added[k]] = priority;
+                }
+            }
+
+            // most important first, in case the slots run out
+            vector<std::pair<float, TileKey> > requests;
+            for (std::map<TileKey, float>::iterator it = wanted.begin(); it != wanted.end(); ++it) {
+                requests.push_back(std::make_pair(it->second, it->first));
+            }
+            std::sort(requests.begin(), requests.end(),
+                      [](const std::pair<float, TileKey> &a, const std::pair<float, TileKey> &b) {
+                          return a.first < b.first;
+                      });
+
+            scheduler_.BeginRequests();
+            for (size_t i = 0; i < requests.size(); ++i) {
+                if (!scheduler_.Request(requests[i].second, requests[i].first, parameters,
+                                        page_texels_, texel_size, use_store_ ? &store_ : nullptr)) {
+                    break;
+                }
+            }
+            scheduler_.CancelStale();
+        }
+
+        // marks the tile as wanted in this update if it is resident, so that
+        // it isn't evicted for a tile that is wanted less
+        bool keep(const TileKey &key, int &kept) {
+            std::map<TileKey, int>::iterator found = resident_.find(key);
+            if (found == resident_.end()) {
+                return false;
+            }
+            Page &page = pages_[found->second];
+            if (page.kept_in != update_) {
+                page.kept_in = update_;
+                lru_.splice(lru_.begin(), lru_, page.lru);
+                kept++;
+            }
+            return true;
+        }
+
+        // a tile generated by a worker, dropped rather than evicting a page
+        // that was wanted during the last update
+        void upload(const TileKey &key, const float *heights) {
+            if (resident_.count(key) || pages_[lru_.back()].kept_in >= update_ - 1) {
+                return;
+            }
+            TRACE_SCOPE("Upload tile");
+            total_streamed_++;
+
+            int page = evict();
+            uploadPage(page, heights);
+            pages_[page].key = key;
+            pages_[page].valid = true;
+            resident_[key] = page;
+            lru_.splice(lru_.begin(), lru_, pages_[page].lru);
+        }
+
+        void uploadPage(int page, const float *heights) {
+            int page_size = page_texels_ + 2;
+            glstate::State().BindTexture(0, GL_TEXTURE_2D_ARRAY, pages_texture_id_);
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, page, page_size, page_size, 1,
+                            GL_RED, GL_FLOAT, heights);
+        }
+
+        // decodes the tile from the store into the page, false if it has
+        // no such tile
+        bool load(const TileKey &key, int page) {
+            if (!use_store_) {
+                return false;
+            }
+            int page_size = page_texels_ + 2;
+            loaded_heights_.resize(page_size * page_size);
+            if (!store_.Read(key.x, key.y, &loaded_heights_[0])) {
+                return false;
+            }
+            TRACE_SCOPE("Load tile");
+            total_loaded_++;
+            uploadPage(page, &loaded_heights_[0]);
+            return true;
+        }
+
+        // the store is only used for the noise and page size it was baked with
+        bool storeMatches(const NoiseParameters &parameters) const {
+            if (!store_.IsOpen()) {
+                return false;
+            }
+            const TileStoreHeader &header = store_.Header();
+            return header.page_texels == (uint32_t) page_texels_ &&
+                   header.heightmap_size == (uint32_t) heightmap_size_ &&
+                   header.scale_factor == parameters.scale_factor &&
+                   header.H == parameters.H && header.lacunarity == parameters.lacunarity &&
+                   header.octaves == parameters.octaves &&
+                   header.cutoff_coef == parameters.cutoff_coef &&
+                   header.offset == parameters.offset;
+        }
+
+        // the noise of the tile and of its border texels
+        void generate(const TileKey &key, int page, ScreenQuad &noise) {
+            TRACE_SCOPE("Generate tile");
+            generated_++;
+            total_generated_++;
+
+            int page_size = page_texels_ + 2;
+            double texel_size = 1.0 / heightmap_size_;
+            glm::vec2 origin = glm::vec2((key.x * page_texels_ - 1) * texel_size,
+                                         (key.y * page_texels_ - 1) * texel_size);
+
+            glstate::State().BindFramebuffer(GL_FRAMEBUFFER, framebuffer_id_);
+            glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, pages_texture_id_, 0, page);
+            const GLenum buffers[] = { GL_COLOR_ATTACHMENT0 };
+            glDrawBuffers(1, buffers);
+            glViewport(0, 0, page_size, page_size);
+            noise.DrawRegion(origin, page_size * texel_size);
+        }
+};
@@ -0,0 +1,29 @@
+#version 330
+
+// Heightmap assembled from the cached tiles: the indirection table gives the
+// page of each tile of the view, pages have a one texel border so that the
+// bilinear filter never reads across tiles.
+
+in vec2 uv;
+
+out vec3 color;
+
+uniform sampler2DArray pages;
+uniform usampler2D indirection;
+uniform vec2 center;
+uniform float texel_size;       // of the heightmap, in noise units
+uniform int page_texels;        // per tile side, without the border
+uniform ivec2 first_tile;       // of the indirection table
+
+void main() {
+
+    // texel coordinates of the whole world, texel centers are integers
+    vec2 texel = (uv + center)/texel_size - 0.5;
+    ivec2 tile = ivec2(floor(floor(texel)/page_texels));
+    uint layer = texelFetch(indirection, tile - first_tile, 0).r;
+
+    vec2 page_texel = texel - vec2(tile*page_texels) + 1.0;
+    float height = texture(pages, vec3((page_texel + 0.5)/(page_texels + 2), layer)).r;
+
+    color = vec3(height, height, height);
+}
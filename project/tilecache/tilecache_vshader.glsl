@@ -0,0 +1,10 @@
+#version 330
+
+out vec2 uv;
+
+// one triangle covering the viewport, no vertex buffer
+void main() {
+    vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    uv = position;
+    gl_Position = vec4(position*2.0 - 1.0, 0.0, 1.0);
+}
@@ -1,6 +1,8 @@
 #pragma once
 #include "icg_helper.h"
 #include "config.h"
+#include "textureloader.h"
+#include "grid.h"
 #include <glm/gtc/type_ptr.hpp>
 
 class Water {
@@ -11,6 +13,7 @@ class Water {
         GLuint vertex_buffer_object_index_;     // memory buffer for indices
         GLuint program_id_;
         GLuint num_indices_;                    // number of vertices to render
+        int grid_resolution_ = 0;
 
         // Textures
         GLuint normal_texture_id_;
@@ -39,6 +42,13 @@ class Water {
         GLuint alpha_id;
         GLuint center_id;
 
+        // Size of the rendered area, and the part of the mirror texture the
+        // reflection covers, both smaller when the resolution is scaled down
+        GLuint viewport_size_id;
+        GLuint mirror_scale_id;
+        glm::vec2 viewport_size = glm::vec2(WINDOW_WIDTH, WINDOW_HEIGHT);
+        glm::vec2 mirror_scale = glm::vec2(1.0f, 1.0f);
+
 
         // Waves
         float transparency = INITIAL_TRANSPARENCY;
@@ -73,7 +83,7 @@ class Water {
         }
 
 
-        void Init(GLuint tex_mirror) {
+        void Init(GLuint tex_mirror, TextureLoader &loader, int grid_resolution = RESOLUTION) {
             // compile the shaders.
             program_id_ = icg_helper::LoadShaders("water_vshader.glsl",
                                                   "water_fshader.glsl",
@@ -83,64 +93,14 @@ class Water {
                 exit(EXIT_FAILURE);
             }
 
-            glUseProgram(program_id_);
+            glstate::State().UseProgram(program_id_);
 
             // vertex one vertex array
             glGenVertexArrays(1, &vertex_array_id_);
-            glBindVertexArray(vertex_array_id_);
+            glstate::State().BindVertexArray(vertex_array_id_);
 
             // vertex coordinates and indices
-            {
-                std::vector<GLfloat> vertices;
-                std::vector<GLuint> indices;
-
-                float triangle_size = WORLD_SIZE/RESOLUTION;
-
-                // Vertex position of the triangles
-                for (int i = 0; i < RESOLUTION; ++i) {
-                    for (int j = 0; j < RESOLUTION; ++j) {
-                        vertices.push_back(triangle_size*i - WORLD_SIZE/2);
-                        vertices.push_back(triangle_size*j - WORLD_SIZE/2);
-                    }
-                }
-
-                // Add indices column by column following an 'S' path
-                for (int i = 1; i < RESOLUTION; i++) {
-                    if(i%2 == 0) {
-                        // Add indices while going up
-                        for (int j = 0; j < RESOLUTION; j++) {
-                            indices.push_back((i-1)*RESOLUTION + j);
-                            indices.push_back(i*RESOLUTION + j);
-                        }
-                    } else {
-                        // Add indices while going down
-                        for (int j = 0; j < RESOLUTION; j++) {
-                            indices.push_back(i*RESOLUTION + (RESOLUTION - 1) - j);
-                            indices.push_back((i-1)*RESOLUTION + (RESOLUTION - 1) - j);
-                        }
-                    }
-                }
-
-                num_indices_ = indices.size();
-
-                // position buffer
-                glGenBuffers(1, &vertex_buffer_object_position_);
-                glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_object_position_);
-                glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat),
-                             &vertices[0], GL_STATIC_DRAW);
-
-                // vertex indices
-                glGenBuffers(1, &vertex_buffer_object_index_);
-                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vertex_buffer_object_index_);
-                glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint),
-                             &indices[0], GL_STATIC_DRAW);
-
-                // position shader attribute
-                GLuint loc_position = glGetAttribLocation(program_id_, "position");
-                glEnableVertexAttribArray(loc_position);
-                glVertexAttribPointer(loc_position, 2, GL_FLOAT, DONT_NORMALIZE,
-                                      ZERO_STRIDE, ZERO_BUFFER_OFFSET);
-            }
+            buildGrid(grid_resolution);
 
             // pass real grid size as uniform
             GLuint world_size_id = glGetUniformLocation(program_id_, "world_size");
@@ -148,53 +108,79 @@ class Water {
 
             {
                 texture_mirror_id_ = tex_mirror;
-                glBindTexture(GL_TEXTURE_2D, texture_mirror_id_);
+                glstate::State().BindTexture(0, GL_TEXTURE_2D, texture_mirror_id_);
                 //glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
                 //glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
                 //GLuint tex_mirror_id = glGetUniformLocation(program_id_, "tex_mirror");
                 //glUniform1i(tex_mirror_id, GL_TEXTURE0);
 
-                initTexture("normal_texture_water.tga", &normal_texture_id_, "normal_tex", GL_TEXTURE1);
-                initTexture("normal_texture_water2.tga", &normal_texture2_id_, "normal_tex2", GL_TEXTURE2);
+                initTexture(loader, "normal_texture_water.tga", &normal_texture_id_, "normal_tex", GL_TEXTURE1);
+                initTexture(loader, "normal_texture_water2.tga", &normal_texture2_id_, "normal_tex2", GL_TEXTURE2);
             }
 
             // other uniforms
             getAllUniformLocation();
 
             // to avoid the current object being polluted
-            glBindVertexArray(0);
-            glUseProgram(0);
+            glstate::State().BindVertexArray(0);
+            glstate::State().UseProgram(0);
         }
 
         void setCenter(glm::vec2 newCenter) {
             center = newCenter;
         }
 
+        // vertices of the water plane per side, rebuilds the buffers
+        void setGridResolution(int resolution) {
+            if (resolution == grid_resolution_) {
+                return;
+            }
+            glstate::State().BindVertexArray(vertex_array_id_);
+            glDeleteBuffers(1, &vertex_buffer_object_position_);
+            glDeleteBuffers(1, &vertex_buffer_object_index_);
+            gpumemory::Registry().Release(GL_BUFFER, vertex_buffer_object_position_);
+            gpumemory::Registry().Release(GL_BUFFER, vertex_buffer_object_index_);
+            buildGrid(resolution);
+        }
+
+        // the reflection target, owned by the render graph
+        void setMirrorTexture(GLuint tex_mirror) {
+            texture_mirror_id_ = tex_mirror;
+        }
+
+        void setViewportSize(int width, int height) {
+            viewport_size = glm::vec2(width, height);
+        }
+
+        // reflection viewport over the mirror texture size
+        void setMirrorScale(glm::vec2 scale) {
+            mirror_scale = scale;
+        }
+
         void Cleanup() {
-            glBindVertexArray(0);
-            glUseProgram(0);
+            glstate::State().BindVertexArray(0);
+            glstate::State().UseProgram(0);
             glDeleteBuffers(1, &vertex_buffer_object_position_);
             glDeleteBuffers(1, &vertex_buffer_object_index_);
-            glDeleteVertexArrays(1, &vertex_array_id_);
-            glDeleteProgram(program_id_);
-            glDeleteTextures(1, &texture_mirror_id_);
-            glDeleteTextures(1, &normal_texture_id_);
-            glDeleteTextures(1, &normal_texture2_id_);
+            gpumemory::Registry().Release(GL_BUFFER, vertex_buffer_object_position_);
+            gpumemory::Registry().Release(GL_BUFFER, vertex_buffer_object_index_);
+            glstate::State().DeleteVertexArrays(1, &vertex_array_id_);
+            glstate::State().DeleteProgram(program_id_);
+            glstate::State().DeleteTextures(1, &normal_texture_id_);
+            glstate::State().DeleteTextures(1, &normal_texture2_id_);
         }
 
         void Draw(float time, const glm::mat4 &model, const glm::mat4 &view,
                   const glm::mat4 &projection, float lightAngle) {
 
-            glUseProgram(program_id_);
-            glBindVertexArray(vertex_array_id_);
+            glstate::StateCache &state = glstate::State();
+            state.UseProgram(program_id_);
+            state.BindVertexArray(vertex_array_id_);
 
             // bind textures
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, texture_mirror_id_);
-            glActiveTexture(GL_TEXTURE1);
-            glBindTexture(GL_TEXTURE_2D, normal_texture_id_);
-            glActiveTexture(GL_TEXTURE2);
-            glBindTexture(GL_TEXTURE_2D, normal_texture2_id_);
+            state.BindTexture(0, GL_TEXTURE_2D, texture_mirror_id_);
+            state.BindTexture(1, GL_TEXTURE_2D, normal_texture_id_);
+            state.BindTexture(2, GL_TEXTURE_2D, normal_texture2_id_);
 
 
             // setup MVP
@@ -217,14 +203,13 @@ class Water {
             glUniform1f(waveSpeed_id, waveSpeed);
             glUniform2fv(waveDir_id, ONE, glm::value_ptr(waveDir));
             glUniform2fv(center_id, ONE, glm::value_ptr(center));
+            glUniform2fv(viewport_size_id, ONE, glm::value_ptr(viewport_size));
+            glUniform2fv(mirror_scale_id, ONE, glm::value_ptr(mirror_scale));
 
             // draw
-            glEnable(GL_BLEND);
+            state.Enable(GL_BLEND);
             glDrawElements(GL_TRIANGLE_STRIP, num_indices_, GL_UNSIGNED_INT, 0);
-            glDisable(GL_BLEND);
-
-            glBindVertexArray(0);
-            glUseProgram(0);
+            state.Disable(GL_BLEND);
         }
 
         void getAllUniformLocation() {
@@ -248,32 +233,51 @@ class Water {
             waveSpeed_id = glGetUniformLocation(program_id_, "waveSpeed");
             alpha_id = glGetUniformLocation(program_id_, "alpha");
             center_id = glGetUniformLocation(program_id_, "center");
+            viewport_size_id = glGetUniformLocation(program_id_, "viewport_size");
+            mirror_scale_id = glGetUniformLocation(program_id_, "mirror_scale");
+        }
+
+        // fills the buffers of the vertex array bound by the caller
+        void buildGrid(int resolution) {
+
+            grid_resolution_ = resolution;
+
+            std::vector<GLfloat> vertices;
+            std::vector<GLuint> indices;
+            BuildStripGrid(resolution, WORLD_SIZE, vertices, indices);
+
+            num_indices_ = indices.size();
+
+            // position buffer
+            glGenBuffers(1, &vertex_buffer_object_position_);
+            glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_object_position_);
+            glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat),
+                         &vertices[0], GL_STATIC_DRAW);
+            gpumemory::Registry().Track(GL_BUFFER, vertex_buffer_object_position_,
+                                        gpumemory::MEMORY_BUFFERS, "Water grid vertices",
+                                        vertices.size() * sizeof(GLfloat));
+
+            // vertex indices
+            glGenBuffers(1, &vertex_buffer_object_index_);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vertex_buffer_object_index_);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint),
+                         &indices[0], GL_STATIC_DRAW);
+            gpumemory::Registry().Track(GL_BUFFER, vertex_buffer_object_index_,
+                                        gpumemory::MEMORY_BUFFERS, "Water grid indices",
+                                        indices.size() * sizeof(GLuint));
+
+            // position shader attribute
+            GLuint loc_position = glGetAttribLocation(program_id_, "position");
+            glEnableVertexAttribArray(loc_position);
+            glVertexAttribPointer(loc_position, 2, GL_FLOAT, DONT_NORMALIZE,
+                                  ZERO_STRIDE, ZERO_BUFFER_OFFSET);
         }
 
-        void initTexture(string filename, GLuint *texture_id, string texture_name, int val) {
-
-                int width;
-                int height;
-                int nb_component;
-                // set stb_image to have the same coordinates as OpenGL
-                stbi_set_flip_vertically_on_load(1);
-                unsigned char *image = stbi_load(filename.c_str(), &width, &height, &nb_component, 0);
-
-                if (image == nullptr) {
-                    throw(string("Failed to load texture"));
-                }
-
-                glGenTextures(1, texture_id);
-                glBindTexture(GL_TEXTURE_2D, *texture_id);
-                glGenerateMipmap(GL_TEXTURE_2D);
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-
-                if (nb_component == 3) {
-                    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-                } else if (nb_component == 4) {
-                    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-                }
+        void initTexture(TextureLoader &loader, string filename, GLuint *texture_id,
+                         string texture_name, int val) {
+
+                // flat normal until the normal map has been decoded
+                *texture_id = loader.Load(filename, false, glm::u8vec3(128, 128, 255));
 
                 GLuint tex_id = glGetUniformLocation(program_id_, texture_name.c_str());
                 glUniform1i(tex_id, val - GL_TEXTURE0);
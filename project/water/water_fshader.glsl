@@ -20,6 +20,8 @@ uniform float reflection;
 uniform float refraction;
 uniform vec2 center;
 uniform float lightAngle;
+uniform vec2 viewport_size;
+uniform vec2 mirror_scale;
 
 in vec4 light_dir;
 in vec4 view_dir;
@@ -67,11 +69,14 @@ void main() {
 
     vec3 ambient = vec3(0.0, 0.0, 0.0);
 
-    // Access reflection texture
-    ivec2 window_size = textureSize(tex_mirror, 0);
-    vec2 uv2 = vec2(1 - gl_FragCoord.x / window_size.x, gl_FragCoord.y / window_size.y);
+    // Access reflection texture, the mirror is rendered in the lower left
+    // mirror_scale corner of the texture. Clamped half a texel inside that
+    // corner, the filtering never reads the unrendered rest of the target
+    vec2 uv2 = vec2(1 - gl_FragCoord.x / viewport_size.x, gl_FragCoord.y / viewport_size.y);
+    vec2 half_texel = 0.5 / vec2(textureSize(tex_mirror, 0));
+    uv2 = clamp((uv2 + fresnel(normal)*waveDirection)*mirror_scale, half_texel, mirror_scale - half_texel);
 
-    vec3 mirror = texture(tex_mirror, uv2 + fresnel(normal)*waveDirection).rgb;
+    vec3 mirror = texture(tex_mirror, uv2).rgb;
 
 
 
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "glm/vec3.hpp"
+
+#include <vector>
+
+class Bezier {
+    private:
+        std::vector<glm::vec3> control_points;
+        int element_count = 0;
+        int spline_degree = 3;
+        int splines = 0;
+
+    public:
+        glm::vec3 getBezier(float t);
+
+        void addControlPoint(glm::vec3 &point);
+
+        int getCount() const {
+            return element_count;
+        }
+
+        const std::vector<glm::vec3> &getControlPoints() const {
+            return control_points;
+        }
+
+        int getDegree() const {
+            return spline_degree;
+        }
+
+        // complete splines, the control points after them form one more
+        int getSplines() const {
+            return splines;
+        }
+
+    private:
+        glm::vec3 calculateBezier(float t, int spline_start, int spline_end);
+
+        float bernstein(float t, int n, int i);
+
+        float binomial(int n, int k);
+
+        float factorial(int n);
+};
@@ -0,0 +1,105 @@
+#include "bezier_path.h"
+
+#include "glm/glm.hpp"
+
+static double binomial(int n, int k) {
+    double result = 1.0;
+    for (int i = 1; i <= k; ++i) {
+        result = result * (n - k + i) / i;
+    }
+    return result;
+}
+
+void BezierPath::Build(const Bezier &curve, int arc_samples_per_point) {
+
+    const std::vector<glm::vec3> &points = curve.getControlPoints();
+    count_ = curve.getCount();
+    segments_.clear();
+    coefficients_.clear();
+    arc_parameters_.assign(1, 0.0f);
+    arc_step_ = 0.0f;
+    length_ = 0.0f;
+    if (count_ < 1) {
+        return;
+    }
+
+    // the splines of Bezier::getBezier: every degree control points, those
+    // starting after the last complete spline end at the last point. Without
+    // complete splines, the whole curve is a single one whose parameter is
+    // scaled by the number of points
+    int degree = curve.getDegree();
+    int splines = curve.getSplines();
+    if (splines < 1) {
+        Segment segment = { 0.0f, 1.0f / count_, count_ - 1, 0 };
+        segments_.push_back(segment);
+        segment_width_ = (float) count_;
+    } else {
+        for (int start = 0; start < count_ - 1; start += degree) {
+            int end = start + degree <= splines * degree ? start + degree : count_ - 1;
+            Segment segment = { (float) start, 1.0f / (end - start), end - start, 0 };
+            segments_.push_back(segment);
+        }
+        segment_width_ = (float) degree;
+    }
+
+    // c_k = C(n, k) sum_i (-1)^(k - i) C(k, i) P_i, for i <= k
+    for (size_t s = 0; s < segments_.size(); ++s) {
+        Segment &segment = segments_[s];
+        segment.first = (int) coefficients_.size();
+        int first_point = (int) segment.start;
+        for (int k = 0; k <= segment.degree; ++k) {
+            glm::dvec3 sum(0.0);
+            for (int i = 0; i <= k; ++i) {
+                double sign = (k - i) % 2 == 0 ? 1.0 : -1.0;
+                sum += sign * binomial(k, i) * glm::dvec3(points[first_point + i]);
+            }
+            coefficients_.push_back(glm::vec3(binomial(segment.degree, k) * sum));
+        }
+    }
+
+    // lengths at regularly spaced parameters, then inverted into parameters
+    // at regularly spaced distances
+    int intervals = (count_ - 1) * arc_samples_per_point;
+    if (intervals < 1) {
+        return;
+    }
+    float end = End();
+    std::vector<float> lengths(intervals + 1, 0.0f);
+    glm::vec3 previous = Evaluate(0.0f);
+    for (int i = 1; i <= intervals; ++i) {
+        glm::vec3 point = Evaluate(end * i / intervals);
+        lengths[i] = lengths[i - 1] + glm::distance(previous, point);
+        previous = point;
+    }
+    length_ = lengths[intervals];
+    if (length_ <= 0.0f) {
+        return;
+    }
+
+    arc_step_ = length_ / intervals;
+    arc_parameters_.resize(intervals + 1);
+    int i = 0;
+    for (int j = 0; j < intervals; ++j) {
+        float distance = arc_step_ * j;
+        while (i < intervals - 1 && lengths[i + 1] < distance) {
+            ++i;
+        }
+        float span = lengths[i + 1] - lengths[i];
+        float f = span > 0.0f ? (distance - lengths[i]) / span : 0.0f;
+        f = glm::clamp(f, 0.0f, 1.0f);
+        arc_parameters_[j] = end * (i + f) / intervals;
+    }
+    arc_parameters_[intervals] = end;
+}
+
+void BezierPath::Evaluate(const float *t, size_t count, glm::vec3 *points) const {
+    for (size_t i = 0; i < count; ++i) {
+        points[i] = Evaluate(t[i]);
+    }
+}
+
+void BezierPath::EvaluateAtDistances(const float *distances, size_t count, glm::vec3 *points) const {
+    for (size_t i = 0; i < count; ++i) {
+        points[i] = Evaluate(ParameterAt(distances[i]));
+    }
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include "glm/vec3.hpp"
+#include "bezier.h"
+
+#include <cstddef>
+#include <vector>
+
+// A Bezier curve prepared for playback. Every spline keeps the coefficients
+// of its polynomial, evaluated with Horner's rule, and a table of the arc
+// length maps distances along the curve to parameters, to fly it at a
+// constant speed. Both take constant time per sample whatever the number of
+// control points. The parameter runs over [0, Count() - 1] and gives the
+// points of Bezier::getBezier.
+//
+//     BezierPath flight(recorded);
+//     glm::vec3 point = flight.Evaluate(flight.ParameterAt(speed * seconds));
+class BezierPath {
+
+    public:
+        static const int ARC_SAMPLES_PER_POINT = 16;
+
+    private:
+        struct Segment {
+            float start;                // parameter at its first control point
+            float scale;                // from the parameter to [0, 1]
+            int degree;
+            int first;                  // of its coefficients
+        };
+
+        std::vector<Segment> segments_;
+        std::vector<glm::vec3> coefficients_;   // lowest power first
+        float segment_width_ = 1.0f;    // in parameter, the last one can be longer
+        int count_ = 0;
+
+        std::vector<float> arc_parameters_;     // at regularly spaced distances
+        float arc_step_ = 0.0f;
+        float length_ = 0.0f;
+
+    public:
+        BezierPath() {}
+
+        explicit BezierPath(const Bezier &curve, int arc_samples_per_point = ARC_SAMPLES_PER_POINT) {
+            Build(curve, arc_samples_per_point);
+        }
+
+        // without arc samples, only Evaluate by parameter is available, e.g.
+        // for the camera angles that follow the parameter of the positions
+        void Build(const Bezier &curve, int arc_samples_per_point = ARC_SAMPLES_PER_POINT);
+
+        int Count() const {
+            return count_;
+        }
+
+        float End() const {
+            return count_ > 1 ? count_ - 1.0f : 0.0f;
+        }
+
+        float Length() const {
+            return length_;
+        }
+
+        glm::vec3 Evaluate(float t) const {
+            if (segments_.empty()) {
+                return glm::vec3(0.0f);
+            }
+            int index = t > 0.0f ? (int) (t / segment_width_) : 0;
+            index = index < (int) segments_.size() ? index : (int) segments_.size() - 1;
+            const Segment &segment = segments_[index];
+
+            float u = (t - segment.start) * segment.scale;
+            const glm::vec3 *c = &coefficients_[segment.first];
+            glm::vec3 point = c[segment.degree];
+            for (int k = segment.degree - 1; k >= 0; --k) {
+                point = point * u + c[k];
+            }
+            return point;
+        }
+
+        // parameter at the given distance from the start, clamped to the path
+        float ParameterAt(float distance) const {
+            if (arc_step_ <= 0.0f) {
+                return 0.0f;
+            }
+            float x = distance / arc_step_;
+            int last = (int) arc_parameters_.size() - 1;
+            if (x <= 0.0f) {
+                return arc_parameters_[0];
+            }
+            if (x >= last) {
+                return arc_parameters_[last];
+            }
+            int i = (int) x;
+            float f = x - i;
+            return arc_parameters_[i] + f * (arc_parameters_[i + 1] - arc_parameters_[i]);
+        }
+
+        void Evaluate(const float *t, size_t count, glm::vec3 *points) const;
+
+        void EvaluateAtDistances(const float *distances, size_t count, glm::vec3 *points) const;
+};
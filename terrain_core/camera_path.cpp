@@ -0,0 +1,152 @@
+#include "camera_path.h"
+
+#include <cstring>
+
+#ifdef _WIN32
+#include <fstream>
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool CameraPath::Open(const char *path) {
+    Close();
+
+#ifdef _WIN32
+    std::ifstream stream(path, std::ios::binary);
+    if (!stream) {
+        return false;
+    }
+    buffer_.assign(std::istreambuf_iterator<char>(stream),
+                   std::istreambuf_iterator<char>());
+    data_ = buffer_.empty() ? nullptr : &buffer_[0];
+    size_ = buffer_.size();
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        close(fd);
+        return false;
+    }
+    void *mapping = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+    // read ahead of the playback, and the pages behind it can be dropped
+    madvise(mapping, info.st_size, MADV_SEQUENTIAL);
+    data_ = (const unsigned char *) mapping;
+    size_ = info.st_size;
+#endif
+
+    const CameraPathHeader *header = (const CameraPathHeader *) data_;
+    if (size_ < sizeof(CameraPathHeader) || memcmp(header->magic, CAMERA_PATH_MAGIC, 4) != 0 ||
+        header->version != CAMERA_PATH_VERSION || header->sample_size != sizeof(CameraPathSample) ||
+        size_ < sizeof(CameraPathHeader) + sizeof(CameraPathSample)) {
+        fprintf(stderr, "Invalid camera path: %s\n", path);
+        Close();
+        return false;
+    }
+    samples_ = (const CameraPathSample *) (data_ + sizeof(CameraPathHeader));
+    count_ = (size_ - sizeof(CameraPathHeader)) / sizeof(CameraPathSample);
+    return true;
+}
+
+void CameraPath::Close() {
+#ifdef _WIN32
+    buffer_.clear();
+#else
+    if (data_ != nullptr) {
+        munmap((void *) data_, size_);
+    }
+#endif
+    data_ = nullptr;
+    size_ = 0;
+    samples_ = nullptr;
+    count_ = 0;
+}
+
+size_t CameraPath::Locate(float time, size_t hint) const {
+    if (count_ < 2 || time <= samples_[0].time) {
+        return 0;
+    }
+    size_t i = hint < count_ - 1 ? hint : count_ - 2;
+
+    // a few frames ahead at most while playing
+    if (samples_[i].time <= time) {
+        for (int step = 0; step < 8 && i + 1 < count_ - 1; ++step) {
+            if (samples_[i + 1].time > time) {
+                return i;
+            }
+            i++;
+        }
+        if (samples_[i + 1].time > time || i + 1 == count_ - 1) {
+            return i;
+        }
+    }
+
+    // after a jump, last sample at or before time
+    size_t low = 0, high = count_ - 1;
+    while (high - low > 1) {
+        size_t middle = low + (high - low) / 2;
+        if (samples_[middle].time <= time) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+CameraPathSample CameraPath::Interpolate(float time, size_t &cursor) const {
+    cursor = Locate(time, cursor);
+    const CameraPathSample &a = samples_[cursor];
+    if (cursor + 1 >= count_) {
+        return a;
+    }
+    const CameraPathSample &b = samples_[cursor + 1];
+    float span = b.time - a.time;
+    float f = span > 0.0f ? (time - a.time) / span : 0.0f;
+    f = f < 0.0f ? 0.0f : (f > 1.0f ? 1.0f : f);
+
+    CameraPathSample sample;
+    sample.time = time;
+    sample.x = a.x + f * (b.x - a.x);
+    sample.y = a.y + f * (b.y - a.y);
+    sample.z = a.z + f * (b.z - a.z);
+    sample.pitch = a.pitch + f * (b.pitch - a.pitch);
+    sample.yaw = a.yaw + f * (b.yaw - a.yaw);
+    return sample;
+}
+
+bool CameraPathWriter::Create(const char *path) {
+    file_ = fopen(path, "wb");
+    if (file_ == nullptr) {
+        fprintf(stderr, "Could not open %s for writing\n", path);
+        return false;
+    }
+    CameraPathHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CAMERA_PATH_MAGIC, 4);
+    header.version = CAMERA_PATH_VERSION;
+    header.sample_size = sizeof(CameraPathSample);
+    fwrite(&header, sizeof(header), 1, file_);
+    count_ = 0;
+    return ferror(file_) == 0;
+}
+
+bool CameraPathWriter::Finish() {
+    bool ok = ferror(file_) == 0;
+    ok = fclose(file_) == 0 && ok;
+    file_ = nullptr;
+    if (!ok) {
+        fprintf(stderr, "Error while writing the camera path\n");
+    }
+    return ok;
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+// Recorded camera flights, one sample per rendered frame.
+//
+// Layout: header, then the samples in time order until the end of the
+// file. There is no count to update, a recording interrupted before it was
+// closed still plays up to its last complete sample. Playback reads the
+// samples straight from a read-only mapping of the file, so only the pages
+// around the current time are kept in memory however long the flight.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+static const char CAMERA_PATH_MAGIC[4] = { 'P', 'T', 'C', 'P' };
+static const uint32_t CAMERA_PATH_VERSION = 1;
+
+struct CameraPathHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t sample_size;       // sizeof(CameraPathSample)
+    uint32_t reserved;
+};
+
+struct CameraPathSample {
+    float time;                 // seconds since the first sample
+    float x;                    // heightmap center
+    float y;                    // eye height
+    float z;
+    float pitch;                // degrees
+    float yaw;
+};
+
+// Read-only view of a recorded flight, mapped in memory where the platform
+// allows
+class CameraPath {
+
+    private:
+        const unsigned char *data_ = nullptr;
+        uint64_t size_ = 0;
+        const CameraPathSample *samples_ = nullptr;
+        size_t count_ = 0;
+#ifdef _WIN32
+        std::vector<unsigned char> buffer_;
+#endif
+
+    public:
+        ~CameraPath() {
+            Close();
+        }
+
+        // returns false if the flight is missing, malformed or empty
+        bool Open(const char *path);
+
+        void Close();
+
+        bool IsOpen() const {
+            return data_ != nullptr;
+        }
+
+        size_t Count() const {
+            return count_;
+        }
+
+        const CameraPathSample &Sample(size_t i) const {
+            return samples_[i];
+        }
+
+        float Duration() const {
+            return count_ > 0 ? samples_[count_ - 1].time : 0.0f;
+        }
+
+        // sample i such that time is between samples i and i + 1. Playback
+        // moves forward, so the search starts from the previous one, given
+        // as the hint
+        size_t Locate(float time, size_t hint) const;
+
+        // linear interpolation of the samples around time, clamped to the
+        // flight. cursor is the hint of Locate and is updated
+        CameraPathSample Interpolate(float time, size_t &cursor) const;
+};
+
+// Appends samples to a flight as they are recorded, without keeping them
+//
+//     CameraPathWriter writer;
+//     writer.Create("flight.path");
+//     writer.Append(sample);
+//     writer.Finish();
+class CameraPathWriter {
+
+    private:
+        FILE *file_ = nullptr;
+        size_t count_ = 0;
+
+    public:
+        ~CameraPathWriter() {
+            if (file_ != nullptr) {
+                fclose(file_);
+            }
+        }
+
+        bool Create(const char *path);
+
+        bool IsOpen() const {
+            return file_ != nullptr;
+        }
+
+        // times have to be increasing
+        bool Append(const CameraPathSample &sample) {
+            if (fwrite(&sample, sizeof(sample), 1, file_) != 1) {
+                return false;
+            }
+            count_++;
+            return true;
+        }
+
+        size_t Count() const {
+            return count_;
+        }
+
+        bool Finish();
+};
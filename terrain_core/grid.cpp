@@ -0,0 +1,58 @@
+#include "grid.h"
+
+static void buildVertices(int resolution, float world_size, std::vector<float> &vertices) {
+
+    float quad_size = world_size/resolution;
+
+    vertices.clear();
+    vertices.reserve(2 * resolution * resolution);
+    for (int i = 0; i < resolution; ++i) {
+        for (int j = 0; j < resolution; ++j) {
+            vertices.push_back(quad_size*i - world_size/2);
+            vertices.push_back(quad_size*j - world_size/2);
+        }
+    }
+}
+
+void BuildPatchGrid(int resolution, float world_size, std::vector<float> &vertices,
+                    std::vector<unsigned int> &indices) {
+
+    buildVertices(resolution, world_size, vertices);
+
+    // the first column of quads is left out
+    indices.clear();
+    indices.reserve(resolution > 2 ? 4 * (resolution - 2) * (resolution - 1) : 0);
+    for (int i = 1; i < resolution - 1; i++) {
+        for (int j = 0; j < resolution - 1; j++) {
+            indices.push_back(i*resolution + j);
+            indices.push_back((i+1)*resolution + j);
+            indices.push_back((i+1)*resolution + j + 1);
+            indices.push_back(i*resolution + j + 1);
+        }
+    }
+}
+
+void BuildStripGrid(int resolution, float world_size, std::vector<float> &vertices,
+                    std::vector<unsigned int> &indices) {
+
+    buildVertices(resolution, world_size, vertices);
+
+    // Add indices column by column following an 'S' path
+    indices.clear();
+    indices.reserve(resolution > 1 ? 2 * (resolution - 1) * resolution : 0);
+    for (int i = 1; i < resolution; i++) {
+        if(i%2 == 0) {
+            // Add indices while going up
+            for (int j = 0; j < resolution; j++) {
+                indices.push_back((i-1)*resolution + j);
+                indices.push_back(i*resolution + j);
+            }
+        } else {
+            // Add indices while going down
+            for (int j = 0; j < resolution; j++) {
+                indices.push_back(i*resolution + (resolution - 1) - j);
+                indices.push_back((i-1)*resolution + (resolution - 1) - j);
+            }
+        }
+    }
+}
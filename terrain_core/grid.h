@@ -0,0 +1,15 @@
+#pragma once
+
+#include <vector>
+
+// Flat grids of resolution x resolution vertices covering a square of side
+// world_size centered on the origin, two coordinates per vertex. Column i
+// of the grid is stored at vertices [2 * i * resolution, ...)
+
+// quads of four indices, for the tessellated terrain patches
+void BuildPatchGrid(int resolution, float world_size, std::vector<float> &vertices,
+                    std::vector<unsigned int> &indices);
+
+// a single triangle strip going up and down the columns, for the water
+void BuildStripGrid(int resolution, float world_size, std::vector<float> &vertices,
+                    std::vector<unsigned int> &indices);
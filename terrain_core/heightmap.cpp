@@ -0,0 +1,22 @@
+#include "heightmap.h"
+
+bool GenerateTile(const NoiseParameters &parameters, const TileKey &key, int page_texels,
+                  double texel_size, float *heights, const std::atomic<bool> *cancel) {
+
+    int page_size = page_texels + 2;
+    double origin_x = (double) key.x * page_texels - 1;
+    double origin_y = (double) key.y * page_texels - 1;
+
+    for (int j = 0; j < page_size; ++j) {
+        if (cancel != nullptr && cancel->load(std::memory_order_relaxed)) {
+            return false;
+        }
+        float y = (origin_y + j + 0.5) * texel_size;
+        float *row = &heights[j * page_size];
+        for (int i = 0; i < page_size; ++i) {
+            float x = (origin_x + i + 0.5) * texel_size;
+            row[i] = noise::Height(parameters, x, y);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include "noise.h"
+
+#include <atomic>
+
+// integer coordinates of a tile of the noise plane
+struct TileKey {
+    int x;
+    int y;
+
+    bool operator<(const TileKey &other) const {
+        return x < other.x || (x == other.x && y < other.y);
+    }
+};
+
+// Fills heights with the page_texels + 2 texels per side of the tile, its
+// border included, rows from the bottom. The heights are taken at the
+// centers of the heightmap texels like the screen quad renders them, texel
+// (i, j) of tile (x, y) at ((x * page_texels - 1 + i + 0.5) * texel_size, ...).
+// Returns false if cancel was set before the last row
+bool GenerateTile(const NoiseParameters &parameters, const TileKey &key, int page_texels,
+                  double texel_size, float *heights, const std::atomic<bool> *cancel = nullptr);
@@ -0,0 +1,78 @@
+#include "noise.h"
+
+#include <cmath>
+
+#include "glm/glm.hpp"
+#include "config.h"
+
+namespace noise {
+
+    static inline float fade(float t) {
+        return t * t * t * (t * (t * 6 - 15) + 10);
+    }
+
+    static inline float mix(float a, float b, float t) {
+        return a * (1.0f - t) + b * t;
+    }
+
+    // dot product of the lattice gradient with the offset to the point
+    static inline float gradient(int hash, float x, float y) {
+        static const float g[8][2] = { { 1, 0 }, { 0, 1 }, { -1, 0 }, { 0, -1 },
+                                       { 1, 1 }, { 1, -1 }, { -1, 1 }, { -1, -1 } };
+        return g[hash][0] * x + g[hash][1] * y;
+    }
+
+    float Perlin(float x, float y) {
+        float px = std::floor(x);
+        float py = std::floor(y);
+        int xi = (int) px;
+        int yi = (int) py;
+        float fx = x - px;
+        float fy = y - py;
+
+        int i1 = perlinPermutation[(perlinPermutation[xi & 255] + yi) & 255] & 7;
+        int i2 = perlinPermutation[(perlinPermutation[xi & 255] + yi + 1) & 255] & 7;
+        int i3 = perlinPermutation[(perlinPermutation[(xi + 1) & 255] + yi + 1) & 255] & 7;
+        int i4 = perlinPermutation[(perlinPermutation[(xi + 1) & 255] + yi) & 255] & 7;
+
+        float s = gradient(i1, fx, fy);
+        float t = gradient(i2, fx, fy - 1.0f);
+        float u = gradient(i3, fx - 1.0f, fy - 1.0f);
+        float w = gradient(i4, fx - 1.0f, fy);
+
+        float st = mix(s, w, fade(fx));
+        float uw = mix(t, u, fade(fx));
+        return mix(st, uw, fade(fy));
+    }
+
+    float FBm(float x, float y, float H, float lacunarity, int octaves, float offset) {
+        float value = 0.0f;
+        float weight = 1.0f;
+        const float gain = 2.0f;
+
+        for (int i = 0; i < octaves; i++) {
+            float signal = offset - std::fabs(Perlin(x, y));
+            signal *= signal;
+            signal *= weight;
+
+            weight = signal * gain;
+            if (weight > 1.0f) {
+                weight = 1.0f;
+            }
+            if (weight < 0.0f) {
+                weight = 0.0f;
+            }
+
+            value += signal * std::pow(lacunarity, -H * i);
+            x *= lacunarity;
+            y *= lacunarity;
+        }
+        return value;
+    }
+
+    float Height(const NoiseParameters &parameters, float x, float y) {
+        float scale = (float) parameters.scale_factor;
+        return FBm(x * scale, y * scale, parameters.H, parameters.lacunarity,
+                   parameters.octaves, parameters.offset) * parameters.cutoff_coef - 0.9f;
+    }
+}
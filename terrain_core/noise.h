@@ -0,0 +1,25 @@
+#pragma once
+
+// parameters of the fBm rendered by the screen quad
+struct NoiseParameters {
+    int scale_factor;
+    float H;
+    float lacunarity;
+    int octaves;
+    float cutoff_coef;
+    float offset;
+};
+
+// The noise of screenquad_fshader.glsl on the CPU, with the same single
+// precision operations, for the threads that have no GL context. Both wrap
+// the lattice coordinates with a mask, so that negative coordinates index
+// the permutation table like positive ones.
+namespace noise {
+
+    float Perlin(float x, float y);
+
+    float FBm(float x, float y, float H, float lacunarity, int octaves, float offset);
+
+    // heightmap value at a point of the noise plane, in heightmap units
+    float Height(const NoiseParameters &parameters, float x, float y);
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include "glm/glm.hpp"
+#include "config.h"
+#include "bezier_path.h"
+#include "camera_path.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Predicts where the heightmap center goes next, so that the tile cache
+// requests the tiles of those views before the camera gets there. Free
+// flight is extrapolated from the current speed and turn rate, the Bezier
+// modes and recorded flights look ahead along their path.
+//
+//     prefetcher.Extrapolate(center, cam_yaw, cam_pitch, speed, yaw_speed, turning);
+//     tile_cache.Update(center, heading, prefetcher.Centers(), screenquad, heightmap);
+class TilePrefetcher {
+
+    public:
+        static const int FRAMES_PER_SAMPLE = 10;    // the flythrough moves once per frame
+        static const int FLIGHT_SAMPLES = 9;
+        static const int PATH_SAMPLES = 12;
+
+    private:
+        std::vector<glm::vec2> centers_;     // soonest first
+
+    public:
+        // e.g. while the camera stands still
+        void Clear() {
+            centers_.clear();
+        }
+
+        // steps the flythrough movement while the camera moves forward or
+        // backward: every frame it moves by speed along its front and turns
+        // by yaw_speed degrees, which decays unless its keys are held
+        void Extrapolate(glm::vec2 center, float yaw, float pitch, float speed, float yaw_speed,
+                         bool yaw_held) {
+
+            centers_.clear();
+            float yaw_decay = yaw_held ? 1.0f : CAM_DECELERATION_FACTOR;
+            float horizontal = cos(glm::radians(pitch));
+
+            for (int sample = 0; sample < FLIGHT_SAMPLES; ++sample) {
+                for (int frame = 0; frame < FRAMES_PER_SAMPLE; ++frame) {
+                    yaw += yaw_speed;
+                    center += speed * horizontal * glm::vec2(cos(glm::radians(yaw)),
+                                                             -sin(glm::radians(yaw)));
+                    yaw_speed *= yaw_decay;
+                }
+                centers_.push_back(center);
+            }
+        }
+
+        // samples the path over the next PREFETCH_SECONDS, from the given
+        // distance along it flown at speed per second. Past its end the
+        // path starts over
+        void LookAhead(const BezierPath &path, float distance, float speed) {
+
+            centers_.clear();
+            float length = path.Length();
+            if (length <= 0.0f || speed <= 0.0f) {
+                return;
+            }
+            float distances[PATH_SAMPLES];
+            glm::vec3 points[PATH_SAMPLES];
+            for (int sample = 0; sample < PATH_SAMPLES; ++sample) {
+                float ahead = distance + speed * PREFETCH_SECONDS * (sample + 1) / PATH_SAMPLES;
+                distances[sample] = ahead > length ? std::min(ahead - length, length) : ahead;
+            }
+            path.EvaluateAtDistances(distances, PATH_SAMPLES, points);
+            for (int sample = 0; sample < PATH_SAMPLES; ++sample) {
+                centers_.push_back(glm::vec2(points[sample].x, points[sample].z));
+            }
+        }
+
+        // samples a recorded flight over the next PREFETCH_SECONDS from the
+        // given time, cursor being where its playback is. Past its end the
+        // flight starts over
+        void LookAhead(const CameraPath &path, float time, size_t cursor) {
+
+            centers_.clear();
+            float duration = path.Duration();
+            if (duration <= 0.0f) {
+                return;
+            }
+            for (int sample = 1; sample <= PATH_SAMPLES; ++sample) {
+                float ahead = time + PREFETCH_SECONDS * sample / PATH_SAMPLES;
+                ahead = ahead > duration ? std::min(ahead - duration, duration) : ahead;
+                CameraPathSample point = path.Interpolate(ahead, cursor);
+                centers_.push_back(glm::vec2(point.x, point.z));
+            }
+        }
+
+        const std::vector<glm::vec2> &Centers() const {
+            return centers_;
+        }
+};
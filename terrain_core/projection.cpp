@@ -0,0 +1,25 @@
+#include "projection.h"
+
+#include "glm/glm.hpp"
+
+#include <cmath>
+
+glm::mat4 PerspectiveProjection(float fovy, float aspect, float near, float far) {
+
+    glm::mat4 proj = glm::mat4(1.0f);
+
+    float top = near*tan(glm::radians(fovy));
+    float bottom = -top;
+    float right = top*aspect;
+    float left = -right;
+
+    proj[0][0] = 2.0f*near / (right - left);
+    proj[1][1] = 2.0f*near / (top - bottom);
+    proj[2][2] = -(far+near) / (far - near);
+    proj[2][3] = -1.0f;
+    proj[2][0] = (right + left) / (right - left);
+    proj[2][1] = (top + bottom) / (top - bottom);
+    proj[3][2] = -2.0f*far*near / (far - near);
+
+    return proj;
+}
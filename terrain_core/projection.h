@@ -0,0 +1,7 @@
+#pragma once
+
+#include "glm/mat4x4.hpp"
+
+// OpenGL perspective projection; unlike glm::perspective, fovy is the
+// angle between the view direction and the top plane, in degrees
+glm::mat4 PerspectiveProjection(float fovy, float aspect, float near, float far);
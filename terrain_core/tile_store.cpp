@@ -0,0 +1,243 @@
+#include "tile_store.h"
+
+#include <cmath>
+#include <cstring>
+
+#ifdef _WIN32
+#include <fstream>
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static inline uint32_t zigzag(int32_t value) {
+    return ((uint32_t) value << 1) ^ (uint32_t) (value >> 31);
+}
+
+static inline int32_t unzigzag(uint32_t value) {
+    return (int32_t) (value >> 1) ^ -(int32_t) (value & 1);
+}
+
+void TileStoreEncode(const float *heights, int page_size, std::vector<unsigned char> &data,
+                     float &min, float &max) {
+
+    int count = page_size * page_size;
+    min = max = heights[0];
+    for (int i = 1; i < count; ++i) {
+        min = heights[i] < min ? heights[i] : min;
+        max = heights[i] > max ? heights[i] : max;
+    }
+    float scale = max > min ? TILE_STORE_MAX_VALUE / (max - min) : 0.0f;
+
+    std::vector<uint32_t> quantised(count);
+    for (int i = 0; i < count; ++i) {
+        quantised[i] = (uint32_t) floor((heights[i] - min) * scale + 0.5f);
+    }
+
+    data.clear();
+    std::vector<uint32_t> deltas(page_size);
+    for (int y = 0; y < page_size; ++y) {
+        const uint32_t *row = &quantised[y * page_size];
+        uint32_t largest = 0;
+        for (int x = 0; x < page_size; ++x) {
+            int32_t previous = x > 0 ? row[x - 1] : (y > 0 ? row[x - page_size] : 0);
+            deltas[x] = zigzag((int32_t) row[x] - previous);
+            largest |= deltas[x];
+        }
+        int bits = 0;
+        while (largest >> bits) {
+            bits++;
+        }
+        data.push_back((unsigned char) bits);
+
+        // least significant bits first
+        uint64_t buffer = 0;
+        int buffered = 0;
+        for (int x = 0; x < page_size; ++x) {
+            buffer |= (uint64_t) deltas[x] << buffered;
+            buffered += bits;
+            while (buffered >= 8) {
+                data.push_back((unsigned char) buffer);
+                buffer >>= 8;
+                buffered -= 8;
+            }
+        }
+        if (buffered > 0) {
+            data.push_back((unsigned char) buffer);
+        }
+    }
+}
+
+bool TileStoreDecode(const unsigned char *data, size_t size, int page_size,
+                     float min, float max, float *heights) {
+
+    float step = (max - min) / TILE_STORE_MAX_VALUE;
+    const unsigned char *end = data + size;
+    int32_t first = 0;              // of the row below
+
+    for (int y = 0; y < page_size; ++y) {
+        if (data == end) {
+            return false;
+        }
+        int bits = *data++;
+        if (bits > 17 || (size_t) (end - data) < ((size_t) bits * page_size + 7) / 8) {
+            return false;
+        }
+        uint32_t mask = (1u << bits) - 1;
+
+        uint64_t buffer = 0;
+        int buffered = 0;
+        int32_t value = 0;
+        for (int x = 0; x < page_size; ++x) {
+            while (buffered < bits) {
+                buffer |= (uint64_t) *data++ << buffered;
+                buffered += 8;
+            }
+            int32_t delta = unzigzag((uint32_t) buffer & mask);
+            buffer >>= bits;
+            buffered -= bits;
+
+            value = (x > 0 ? value : first) + delta;
+            if (x == 0) {
+                first = value;
+            }
+            heights[y * page_size + x] = min + value * step;
+        }
+    }
+    return true;
+}
+
+bool TileStore::Open(const char *path) {
+    Close();
+
+#ifdef _WIN32
+    std::ifstream stream(path, std::ios::in | std::ios::binary);
+    if (!stream.is_open()) {
+        return false;
+    }
+    buffer_.assign(std::istreambuf_iterator<char>(stream),
+                   std::istreambuf_iterator<char>());
+    data_ = buffer_.empty() ? nullptr : &buffer_[0];
+    size_ = buffer_.size();
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        close(fd);
+        return false;
+    }
+    void *mapping = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+    data_ = (const unsigned char *) mapping;
+    size_ = info.st_size;
+#endif
+
+    if (!validate()) {
+        fprintf(stderr, "Invalid tile store: %s\n", path);
+        Close();
+        return false;
+    }
+    return true;
+}
+
+void TileStore::Close() {
+#ifdef _WIN32
+    buffer_.clear();
+#else
+    if (data_ != nullptr) {
+        munmap((void *) data_, size_);
+    }
+#endif
+    data_ = nullptr;
+    size_ = 0;
+    header_ = nullptr;
+    entries_ = nullptr;
+}
+
+bool TileStore::validate() {
+    if (size_ < sizeof(TileStoreHeader)) {
+        return false;
+    }
+    header_ = (const TileStoreHeader *) data_;
+    if (memcmp(header_->magic, TILE_STORE_MAGIC, 4) != 0 ||
+        header_->version != TILE_STORE_VERSION || header_->page_texels == 0) {
+        return false;
+    }
+    // stores come from other machines, the bounds are checked without
+    // sums or products that could wrap around
+    uint64_t num_entries = (uint64_t) header_->width * header_->height;
+    if (header_->index_offset > size_ ||
+        num_entries > (size_ - header_->index_offset) / sizeof(TileStoreEntry)) {
+        return false;
+    }
+
+    entries_ = (const TileStoreEntry *) (data_ + header_->index_offset);
+    for (uint64_t i = 0; i < num_entries; ++i) {
+        if (entries_[i].offset > size_ || entries_[i].size > size_ - entries_[i].offset) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool TileStoreWriter::Create(const char *path, const TileStoreHeader &header) {
+    file_ = fopen(path, "wb");
+    if (file_ == nullptr) {
+        fprintf(stderr, "Could not open %s for writing\n", path);
+        return false;
+    }
+    header_ = header;
+    memcpy(header_.magic, TILE_STORE_MAGIC, 4);
+    header_.version = TILE_STORE_VERSION;
+    header_.index_offset = sizeof(TileStoreHeader);
+
+    TileStoreEntry empty;
+    memset(&empty, 0, sizeof(empty));
+    entries_.assign((size_t) header_.width * header_.height, empty);
+
+    // the index is rewritten by Finish()
+    fwrite(&header_, sizeof(header_), 1, file_);
+    fwrite(&entries_[0], sizeof(TileStoreEntry), entries_.size(), file_);
+    written_ = header_.index_offset + entries_.size() * sizeof(TileStoreEntry);
+    return true;
+}
+
+bool TileStoreWriter::WriteEncoded(int x, int y, const unsigned char *data, size_t size,
+                                   float min, float max) {
+    int64_t column = (int64_t) x - header_.origin_x;
+    int64_t row = (int64_t) y - header_.origin_y;
+    if (column < 0 || row < 0 || column >= header_.width || row >= header_.height) {
+        fprintf(stderr, "Tile %d %d is outside of the store\n", x, y);
+        return false;
+    }
+    TileStoreEntry &entry = entries_[row * header_.width + column];
+    entry.offset = written_;
+    entry.size = size;
+    entry.min = min;
+    entry.max = max;
+    fwrite(data, 1, size, file_);
+    written_ += size;
+    return ferror(file_) == 0;
+}
+
+bool TileStoreWriter::Finish() {
+    fseek(file_, 0, SEEK_SET);
+    fwrite(&header_, sizeof(header_), 1, file_);
+    fwrite(&entries_[0], sizeof(TileStoreEntry), entries_.size(), file_);
+    bool ok = ferror(file_) == 0;
+    ok = fclose(file_) == 0 && ok;
+    file_ = nullptr;
+    if (!ok) {
+        fprintf(stderr, "Error while writing the tile store\n");
+    }
+    return ok;
+}
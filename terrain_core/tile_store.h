@@ -0,0 +1,156 @@
+#pragma once
+
+// Baked heightmap tiles of a rectangular region of the noise plane.
+//
+// Layout: header, index of width x height entries in row-major order, then
+// the data of every tile. A tile is a page of the tile cache, its border
+// included, quantised to 16 bits between its min and its max. Each row is
+// stored as the zigzag encoded deltas of the quantised heights, the first
+// one from the texel below, bit-packed at the width of its largest delta
+// given in a leading byte. Tiles are decoded straight from a read-only
+// mapping of the file.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+static const char TILE_STORE_MAGIC[4] = { 'P', 'T', 'T', 'S' };
+static const uint32_t TILE_STORE_VERSION = 1;
+static const uint32_t TILE_STORE_MAX_VALUE = 65535;
+
+struct TileStoreHeader {
+    char magic[4];
+    uint32_t version;
+    int32_t origin_x;           // first tile of the region
+    int32_t origin_y;
+    uint32_t width;             // in tiles
+    uint32_t height;
+    uint32_t page_texels;       // per tile side, without the border
+    uint32_t heightmap_size;    // texels per heightmap unit
+
+    // noise the tiles were generated with
+    int32_t scale_factor;
+    float H;
+    float lacunarity;
+    int32_t octaves;
+    float cutoff_coef;
+    float offset;
+
+    uint64_t index_offset;
+};
+
+struct TileStoreEntry {
+    uint64_t offset;            // from the start of the file
+    uint32_t size;              // in bytes, 0 if the tile wasn't baked
+    uint32_t reserved;
+    float min;
+    float max;
+};
+
+// compresses a page of page_size x page_size heights, rows from the bottom
+void TileStoreEncode(const float *heights, int page_size, std::vector<unsigned char> &data,
+                     float &min, float &max);
+
+// returns false if the data is truncated or malformed
+bool TileStoreDecode(const unsigned char *data, size_t size, int page_size,
+                     float min, float max, float *heights);
+
+// Read-only view of a store, mapped in memory where the platform allows.
+// Reading tiles is safe from any number of threads
+class TileStore {
+
+    private:
+        const unsigned char *data_ = nullptr;
+        uint64_t size_ = 0;
+        const TileStoreHeader *header_ = nullptr;
+        const TileStoreEntry *entries_ = nullptr;
+#ifdef _WIN32
+        std::vector<unsigned char> buffer_;
+#endif
+
+    public:
+        ~TileStore() {
+            Close();
+        }
+
+        // returns false if the store is missing or malformed
+        bool Open(const char *path);
+
+        void Close();
+
+        bool IsOpen() const {
+            return data_ != nullptr;
+        }
+
+        const TileStoreHeader &Header() const {
+            return *header_;
+        }
+
+        // returns nullptr if the tile is outside of the region or wasn't baked
+        const TileStoreEntry *Find(int x, int y) const {
+            int64_t column = (int64_t) x - header_->origin_x;
+            int64_t row = (int64_t) y - header_->origin_y;
+            if (column < 0 || row < 0 || column >= header_->width || row >= header_->height) {
+                return nullptr;
+            }
+            const TileStoreEntry *entry = &entries_[row * header_->width + column];
+            return entry->size > 0 ? entry : nullptr;
+        }
+
+        // decodes the page_texels + 2 heights per side of the tile
+        bool Read(int x, int y, float *heights) const {
+            const TileStoreEntry *entry = Find(x, y);
+            if (entry == nullptr) {
+                return false;
+            }
+            return TileStoreDecode(data_ + entry->offset, entry->size,
+                                   header_->page_texels + 2, entry->min, entry->max, heights);
+        }
+
+    private:
+        bool validate();
+};
+
+// Writes a store tile by tile, the index is written last
+//
+//     TileStoreWriter writer;
+//     writer.Create("terrain.tiles", header);
+//     writer.Write(x, y, heights);
+//     writer.Finish();
+class TileStoreWriter {
+
+    private:
+        FILE *file_ = nullptr;
+        TileStoreHeader header_;
+        std::vector<TileStoreEntry> entries_;
+        uint64_t written_ = 0;
+        std::vector<unsigned char> encoded_;
+
+    public:
+        ~TileStoreWriter() {
+            if (file_ != nullptr) {
+                fclose(file_);
+            }
+        }
+
+        // the region, page size and noise of the header are kept, the rest
+        // is filled in
+        bool Create(const char *path, const TileStoreHeader &header);
+
+        // heights of page_texels + 2 texels per side
+        bool Write(int x, int y, const float *heights) {
+            float min, max;
+            TileStoreEncode(heights, header_.page_texels + 2, encoded_, min, max);
+            return WriteEncoded(x, y, &encoded_[0], encoded_.size(), min, max);
+        }
+
+        // a tile encoded by TileStoreEncode(), e.g. by another process
+        bool WriteEncoded(int x, int y, const unsigned char *data, size_t size, float min, float max);
+
+        uint64_t BytesWritten() const {
+            return written_;
+        }
+
+        bool Finish();
+};
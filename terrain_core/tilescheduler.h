@@ -0,0 +1,295 @@
+#pragma once
+#include "heightmap.h"
+#include "tile_store.h"
+#include "trace.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <map>
+#include <vector>
+
+// Generates tiles of the noise plane on worker threads, most important
+// first. The render thread and the workers share a fixed array of request
+// slots and nothing else: a slot changes hands through its atomic state, a
+// worker claims the queued slot of lowest priority with a compare-exchange
+// and publishes the heights by marking it done. Every frame the render
+// thread requests the tiles it wants with fresh priorities, and the
+// requests it didn't renew are cancelled, even while being generated.
+//
+//     scheduler.BeginRequests();
+//     scheduler.Request(key, priority, parameters, page_texels, texel_size, store);
+//     scheduler.CancelStale();
+//     scheduler.Collect([&](const TileKey &key, const float *heights) { ... });
+class TileScheduler {
+
+    public:
+        static const int MAX_REQUESTS = 32;     // queued or generated at once
+
+    private:
+        // FREE, DONE and CANCELLED slots belong to the render thread, RUNNING
+        // ones to a worker, QUEUED ones to whoever swaps the state first
+        enum RequestState { REQUEST_FREE, REQUEST_QUEUED, REQUEST_RUNNING,
+                            REQUEST_DONE, REQUEST_CANCELLED };
+
+        struct Slot {
+            std::atomic<int> state;
+            std::atomic<float> priority;        // lower first
+            std::atomic<bool> cancel;           // checked by the worker every row
+
+            // written by the render thread before queuing
+            TileKey key;
+            NoiseParameters parameters;
+            int page_texels;
+            double texel_size;
+            const TileStore *store;             // read instead when it has the tile
+            int requested_in;                   // render thread only
+
+            // written by the worker, page_texels + 2 texels per side
+            std::vector<float> heights;
+        };
+
+        Slot requests_[MAX_REQUESTS];
+        std::map<TileKey, int> pending_;        // slot of each requested tile, render thread only
+        int frame_ = 0;
+
+        std::vector<std::thread> workers_;
+        std::atomic<bool> stop_;
+
+        // only lets idle workers sleep, requests don't go through it
+        std::mutex sleep_mutex_;
+        std::condition_variable wake_;
+
+        int completed_ = 0;
+        int cancelled_ = 0;
+
+    public:
+        TileScheduler() {
+            stop_ = false;
+            for (int i = 0; i < MAX_REQUESTS; ++i) {
+                requests_[i].state = REQUEST_FREE;
+                requests_[i].priority = 0.0f;
+                requests_[i].cancel = false;
+            }
+        }
+
+        void Start(int num_threads = 0) {
+            // leaves a core to the render thread and the texture decoders
+            if (num_threads <= 0) {
+                num_threads = std::thread::hardware_concurrency() - 1;
+                num_threads = num_threads < 1 ? 1 : (num_threads > 4 ? 4 : num_threads);
+            }
+            stop_ = false;
+            for (int i = 0; i < num_threads; ++i) {
+                workers_.push_back(std::thread(&TileScheduler::workerLoop, this));
+            }
+        }
+
+        // cancels everything and waits for the workers
+        void Stop() {
+            stop_ = true;
+            for (int i = 0; i < MAX_REQUESTS; ++i) {
+                requests_[i].cancel = true;
+            }
+            wake_.notify_all();
+            for (size_t i = 0; i < workers_.size(); ++i) {
+                workers_[i].join();
+            }
+            workers_.clear();
+            for (int i = 0; i < MAX_REQUESTS; ++i) {
+                requests_[i].state = REQUEST_FREE;
+                requests_[i].cancel = false;
+            }
+            pending_.clear();
+        }
+
+        // the requests made until CancelStale() are the ones still wanted
+        void BeginRequests() {
+            frame_++;
+        }
+
+        // queues the tile, or updates its priority if it already is; false
+        // when every slot is taken. The tile is decoded from the store if it
+        // has it, which must have been baked with the same noise and sizes
+        bool Request(const TileKey &key, float priority, const NoiseParameters &parameters,
+                     int page_texels, double texel_size, const TileStore *store = nullptr) {
+
+            std::map<TileKey, int>::iterator found = pending_.find(key);
+            if (found != pending_.end()) {
+                Slot &request = requests_[found->second];
+                request.priority.store(priority, std::memory_order_relaxed);
+                request.requested_in = frame_;
+                return true;
+            }
+
+            for (int slot = 0; slot < MAX_REQUESTS; ++slot) {
+                Slot &request = requests_[slot];
+                if (request.state.load(std::memory_order_acquire) != REQUEST_FREE) {
+                    continue;
+                }
+                request.key = key;
+                request.parameters = parameters;
+                request.page_texels = page_texels;
+                request.texel_size = texel_size;
+                request.store = store;
+                request.requested_in = frame_;
+                request.priority.store(priority, std::memory_order_relaxed);
+                request.cancel.store(false, std::memory_order_relaxed);
+                request.state.store(REQUEST_QUEUED, std::memory_order_release);
+                pending_[key] = slot;
+                wake_.notify_one();
+                return true;
+            }
+            return false;
+        }
+
+        bool IsPending(const TileKey &key) const {
+            return pending_.count(key) > 0;
+        }
+
+        // drops the tile, a worker generating it gives up at the next row.
+        // Requesting it again takes a new slot, the old one is freed once
+        // the worker lets go of it
+        void Cancel(const TileKey &key) {
+            std::map<TileKey, int>::iterator found = pending_.find(key);
+            if (found == pending_.end()) {
+                return;
+            }
+            Slot &request = requests_[found->second];
+            int expected = REQUEST_QUEUED;
+            if (request.state.compare_exchange_strong(expected, REQUEST_FREE)) {
+                cancelled_++;
+            } else {
+                request.cancel.store(true, std::memory_order_relaxed);
+            }
+            pending_.erase(found);
+        }
+
+        void CancelAll() {
+            BeginRequests();
+            CancelStale();
+        }
+
+        // cancels the tiles not requested since BeginRequests()
+        void CancelStale() {
+            std::vector<TileKey> stale;
+            for (std::map<TileKey, int>::iterator it = pending_.begin(); it != pending_.end(); ++it) {
+                if (requests_[it->second].requested_in != frame_) {
+                    stale.push_back(it->first);
+                }
+            }
+            for (size_t i = 0; i < stale.size(); ++i) {
+                Cancel(stale[i]);
+            }
+        }
+
+        // calls deliver(key, heights) for every tile generated since the last
+        // call and frees their slots
+        template<typename Deliver>
+        void Collect(Deliver deliver) {
+            for (int slot = 0; slot < MAX_REQUESTS; ++slot) {
+                Slot &request = requests_[slot];
+                int state = request.state.load(std::memory_order_acquire);
+                if (state != REQUEST_DONE && state != REQUEST_CANCELLED) {
+                    continue;
+                }
+                // the cancelled ones are not pending anymore
+                if (state == REQUEST_DONE && !request.cancel.load(std::memory_order_relaxed)) {
+                    deliver(request.key, request.heights.data());
+                    completed_++;
+                    pending_.erase(request.key);
+                } else {
+                    cancelled_++;
+                }
+                request.state.store(REQUEST_FREE, std::memory_order_release);
+            }
+        }
+
+        int Pending() const {
+            return pending_.size();
+        }
+
+        int Running() const {
+            int running = 0;
+            for (int slot = 0; slot < MAX_REQUESTS; ++slot) {
+                running += requests_[slot].state.load(std::memory_order_relaxed) == REQUEST_RUNNING;
+            }
+            return running;
+        }
+
+        int Completed() const {
+            return completed_;
+        }
+
+        int Cancelled() const {
+            return cancelled_;
+        }
+
+        int Workers() const {
+            return workers_.size();
+        }
+
+    private:
+        // slot of the most important queued tile, now RUNNING, or -1
+        int claim() {
+            while (true) {
+                int best = -1;
+                float best_priority = 0.0f;
+                for (int slot = 0; slot < MAX_REQUESTS; ++slot) {
+                    if (requests_[slot].state.load(std::memory_order_relaxed) != REQUEST_QUEUED) {
+                        continue;
+                    }
+                    float priority = requests_[slot].priority.load(std::memory_order_relaxed);
+                    if (best < 0 || priority < best_priority) {
+                        best = slot;
+                        best_priority = priority;
+                    }
+                }
+                if (best < 0) {
+                    return -1;
+                }
+                // taken by another worker or cancelled meanwhile, look again
+                int expected = REQUEST_QUEUED;
+                if (requests_[best].state.compare_exchange_strong(expected, REQUEST_RUNNING,
+                                                                  std::memory_order_acq_rel)) {
+                    return best;
+                }
+            }
+        }
+
+        void workerLoop() {
+
+            trace::SetThreadName("Tile generator");
+            while (!stop_) {
+                int slot = claim();
+                if (slot < 0) {
+                    // a request made between claim() and the wait is seen
+                    // after the timeout at worst
+                    std::unique_lock<std::mutex> lock(sleep_mutex_);
+                    wake_.wait_for(lock, std::chrono::milliseconds(5));
+                    continue;
+                }
+                generate(requests_[slot]);
+            }
+        }
+
+        void generate(Slot &request) {
+
+            TRACE_SCOPE("Generate tile");
+            int page_size = request.page_texels + 2;
+            request.heights.resize(page_size * page_size);
+
+            if (request.store != nullptr &&
+                request.store->Read(request.key.x, request.key.y, &request.heights[0])) {
+                request.state.store(REQUEST_DONE, std::memory_order_release);
+                return;
+            }
+
+            bool generated = GenerateTile(request.parameters, request.key, request.page_texels,
+                                          request.texel_size, &request.heights[0], &request.cancel);
+            request.state.store(generated ? REQUEST_DONE : REQUEST_CANCELLED,
+                                std::memory_order_release);
+        }
+};
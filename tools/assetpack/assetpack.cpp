@@ -0,0 +1,179 @@
+// Packs textures and their full mip chains into a single archive that the
+// viewer maps and uploads without decoding anything at startup.
+//
+// usage: assetpack <output> <image>...
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#include "asset_archive.h"
+
+using namespace std;
+
+struct PackedTexture {
+    AssetArchiveEntry entry;
+    vector<vector<unsigned char>> levels;
+};
+
+// halves an image with a box filter, odd sizes repeat the last row/column
+static vector<unsigned char> downsample(const vector<unsigned char> &src, int width, int height,
+                                        int components, int new_width, int new_height) {
+
+    vector<unsigned char> dst(new_width * new_height * components);
+    for (int y = 0; y < new_height; ++y) {
+        int y0 = min(2 * y, height - 1);
+        int y1 = min(2 * y + 1, height - 1);
+        for (int x = 0; x < new_width; ++x) {
+            int x0 = min(2 * x, width - 1);
+            int x1 = min(2 * x + 1, width - 1);
+            for (int c = 0; c < components; ++c) {
+                int sum = src[(y0 * width + x0) * components + c] +
+                          src[(y0 * width + x1) * components + c] +
+                          src[(y1 * width + x0) * components + c] +
+                          src[(y1 * width + x1) * components + c];
+                dst[(y * new_width + x) * components + c] = (unsigned char) ((sum + 2) / 4);
+            }
+        }
+    }
+    return dst;
+}
+
+static bool packTexture(const string &path, PackedTexture &texture) {
+
+    int width, height, components;
+    unsigned char *image = stbi_load(path.c_str(), &width, &height, &components, 0);
+    if (image == nullptr) {
+        fprintf(stderr, "Could not load %s: %s\n", path.c_str(), stbi_failure_reason());
+        return false;
+    }
+    if (components != 3 && components != 4) {
+        fprintf(stderr, "Unsupported component count %d in %s\n", components, path.c_str());
+        stbi_image_free(image);
+        return false;
+    }
+
+    string name = AssetArchiveName(path);
+    if (name.size() >= ASSET_ARCHIVE_NAME_LENGTH) {
+        fprintf(stderr, "File name too long: %s\n", name.c_str());
+        stbi_image_free(image);
+        return false;
+    }
+
+    memset(&texture.entry, 0, sizeof(texture.entry));
+    strcpy(texture.entry.name, name.c_str());
+    texture.entry.format = components == 3 ? ASSET_FORMAT_RGB8 : ASSET_FORMAT_RGBA8;
+
+    texture.levels.clear();
+    texture.levels.push_back(vector<unsigned char>(image, image + width * height * components));
+    stbi_image_free(image);
+
+    // same chain as glGenerateMipmap, down to 1x1
+    int level_width = width;
+    int level_height = height;
+    while (true) {
+        AssetArchiveLevel &level = texture.entry.levels[texture.levels.size() - 1];
+        level.width = level_width;
+        level.height = level_height;
+        level.size = level_width * level_height * components;
+
+        if ((level_width == 1 && level_height == 1) ||
+            texture.levels.size() == ASSET_ARCHIVE_MAX_LEVELS) {
+            break;
+        }
+        int new_width = max(level_width / 2, 1);
+        int new_height = max(level_height / 2, 1);
+        texture.levels.push_back(downsample(texture.levels.back(), level_width, level_height,
+                                            components, new_width, new_height));
+        level_width = new_width;
+        level_height = new_height;
+    }
+    texture.entry.num_levels = texture.levels.size();
+
+    printf("Packed %s: %dx%d, %d levels\n", name.c_str(), width, height,
+           (int) texture.entry.num_levels);
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s <output> <image>...\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // the viewer samples images bottom-up, like OpenGL
+    stbi_set_flip_vertically_on_load(1);
+
+    vector<PackedTexture> textures;
+    for (int i = 2; i < argc; ++i) {
+        PackedTexture texture;
+        if (!packTexture(argv[i], texture)) {
+            return EXIT_FAILURE;
+        }
+        textures.push_back(texture);
+    }
+
+    // assign offsets
+    AssetArchiveHeader header;
+    memcpy(header.magic, ASSET_ARCHIVE_MAGIC, 4);
+    header.version = ASSET_ARCHIVE_VERSION;
+    header.num_entries = textures.size();
+    header.reserved = 0;
+    header.toc_offset = sizeof(AssetArchiveHeader);
+
+    uint64_t offset = header.toc_offset + textures.size() * sizeof(AssetArchiveEntry);
+    for (size_t t = 0; t < textures.size(); ++t) {
+        offset = AssetArchiveAlign(offset, ASSET_ARCHIVE_ENTRY_ALIGNMENT);
+        for (uint32_t l = 0; l < textures[t].entry.num_levels; ++l) {
+            offset = AssetArchiveAlign(offset, ASSET_ARCHIVE_LEVEL_ALIGNMENT);
+            textures[t].entry.levels[l].offset = offset;
+            offset += textures[t].entry.levels[l].size;
+        }
+    }
+
+    // write everything out, zero padding between blocks
+    FILE *file = fopen(argv[1], "wb");
+    if (file == nullptr) {
+        fprintf(stderr, "Could not open %s for writing\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    uint64_t written = 0;
+    auto writeAt = [&](uint64_t position, const void *data, size_t size) {
+        static const char zeros[ASSET_ARCHIVE_ENTRY_ALIGNMENT] = { 0 };
+        while (written < position) {
+            size_t padding = (size_t) min<uint64_t>(position - written, sizeof(zeros));
+            fwrite(zeros, 1, padding, file);
+            written += padding;
+        }
+        fwrite(data, 1, size, file);
+        written += size;
+    };
+
+    writeAt(0, &header, sizeof(header));
+    for (size_t t = 0; t < textures.size(); ++t) {
+        writeAt(written, &textures[t].entry, sizeof(AssetArchiveEntry));
+    }
+    for (size_t t = 0; t < textures.size(); ++t) {
+        for (uint32_t l = 0; l < textures[t].entry.num_levels; ++l) {
+            writeAt(textures[t].entry.levels[l].offset, &textures[t].levels[l][0],
+                    textures[t].levels[l].size());
+        }
+    }
+
+    bool ok = ferror(file) == 0;
+    ok = fclose(file) == 0 && ok;
+    if (!ok) {
+        fprintf(stderr, "Error while writing %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    printf("Wrote %s: %d textures, %.1f MB\n", argv[1], (int) textures.size(),
+           written / (1024.0 * 1024.0));
+    return EXIT_SUCCESS;
+}
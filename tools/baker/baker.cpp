@@ -0,0 +1,480 @@
+// Bakes a region of the terrain into a tile store the viewer streams from,
+// or into a raw or PGM heightmap, with the noise of the terrain sliders.
+// The tiles are dealt to worker processes that generate and compress their
+// share on several threads and send the compressed tiles back through a
+// pipe; this process only writes them out.
+//
+// usage: baker <output> [options]
+//   --region <x> <y> <width> <height>   in tiles, default 0 0 4 4
+//   --tile <texels>                     per tile side, default 384
+//   --heightmap-size <texels>           per heightmap unit, default 4 tiles
+//   --format tiles|raw|pgm              default tiles
+//   --processes <n>                     default 1
+//   --threads <n>                       per process, default all cores
+//   --scale <n> --H <x> --lacunarity <x> --octaves <n> --cutoff <x> --offset <x>
+//
+// raw is 32-bit floats and pgm 16-bit between the extreme heights, both
+// with the top row (largest y) first.
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "glm/glm.hpp"
+#include "config.h"
+#include "heightmap.h"
+#include "tile_store.h"
+
+using namespace std;
+
+struct BakeOptions {
+    string output;
+    string format = "tiles";
+    int origin_x = 0;
+    int origin_y = 0;
+    int width = 4;
+    int height = 4;
+    int page_texels = 384;          // the High preset
+    int heightmap_size = 0;
+    int processes = 1;
+    int threads = 0;
+    NoiseParameters noise = { INITIAL_SCALE, INITIAL_H, INITIAL_LACUNARITY, INITIAL_OCTAVES,
+                              INITIAL_CUT_COEFF, INITIAL_OFFSET };
+};
+
+// sent ahead of the data of every tile
+struct BakedTile {
+    int32_t x;
+    int32_t y;
+    uint32_t size;
+    float min;
+    float max;
+};
+
+typedef chrono::steady_clock Clock;
+
+static void usage(const char *program) {
+    fprintf(stderr, "usage: %s <output> [--region <x> <y> <width> <height>] [--tile <texels>]\n"
+                    "       [--heightmap-size <texels>] [--format tiles|raw|pgm]\n"
+                    "       [--processes <n>] [--threads <n>] [--scale <n>] [--H <x>]\n"
+                    "       [--lacunarity <x>] [--octaves <n>] [--cutoff <x>] [--offset <x>]\n",
+            program);
+}
+
+static bool parseOptions(int argc, char *argv[], BakeOptions &options) {
+    if (argc < 2 || argv[1][0] == '-') {
+        return false;
+    }
+    options.output = argv[1];
+    for (int i = 2; i < argc; ++i) {
+        string arg = argv[i];
+        int remaining = argc - i - 1;
+        if (arg == "--region" && remaining >= 4) {
+            options.origin_x = atoi(argv[++i]);
+            options.origin_y = atoi(argv[++i]);
+            options.width = atoi(argv[++i]);
+            options.height = atoi(argv[++i]);
+        } else if (arg == "--tile" && remaining >= 1) {
+            options.page_texels = atoi(argv[++i]);
+        } else if (arg == "--heightmap-size" && remaining >= 1) {
+            options.heightmap_size = atoi(argv[++i]);
+        } else if (arg == "--format" && remaining >= 1) {
+            options.format = argv[++i];
+        } else if (arg == "--processes" && remaining >= 1) {
+            options.processes = atoi(argv[++i]);
+        } else if (arg == "--threads" && remaining >= 1) {
+            options.threads = atoi(argv[++i]);
+        } else if (arg == "--scale" && remaining >= 1) {
+            options.noise.scale_factor = atoi(argv[++i]);
+        } else if (arg == "--H" && remaining >= 1) {
+            options.noise.H = atof(argv[++i]);
+        } else if (arg == "--lacunarity" && remaining >= 1) {
+            options.noise.lacunarity = atof(argv[++i]);
+        } else if (arg == "--octaves" && remaining >= 1) {
+            options.noise.octaves = atoi(argv[++i]);
+        } else if (arg == "--cutoff" && remaining >= 1) {
+            options.noise.cutoff_coef = atof(argv[++i]);
+        } else if (arg == "--offset" && remaining >= 1) {
+            options.noise.offset = atof(argv[++i]);
+        } else {
+            fprintf(stderr, "Unknown or incomplete option %s\n", arg.c_str());
+            return false;
+        }
+    }
+
+    if (options.heightmap_size <= 0) {
+        options.heightmap_size = options.page_texels * TILES_PER_VIEW;
+    }
+    if (options.threads <= 0) {
+        options.threads = max((int) thread::hardware_concurrency(), 1);
+    }
+#ifdef _WIN32
+    options.processes = 1;
+#endif
+    if (options.width <= 0 || options.height <= 0 || options.page_texels <= 0 ||
+        options.processes <= 0 || options.noise.octaves <= 0) {
+        fprintf(stderr, "Region, tile size, processes and octaves must be positive\n");
+        return false;
+    }
+    if (options.format != "tiles" && options.format != "raw" && options.format != "pgm") {
+        fprintf(stderr, "Unknown format %s\n", options.format.c_str());
+        return false;
+    }
+    return true;
+}
+
+// generates and compresses every processes-th tile of the region starting
+// at rank on all threads, deliver(tile, data) is called under a lock
+template<typename Deliver>
+static bool bakeShard(const BakeOptions &options, int rank, Deliver deliver) {
+
+    int num_tiles = options.width * options.height;
+    atomic<int> next(rank);
+    atomic<bool> failed(false);
+    mutex deliver_mutex;
+
+    auto work = [&]() {
+        int page_size = options.page_texels + 2;
+        vector<float> heights(page_size * page_size);
+        vector<unsigned char> data;
+        while (!failed) {
+            int index = next.fetch_add(options.processes);
+            if (index >= num_tiles) {
+                return;
+            }
+            BakedTile tile;
+            tile.x = options.origin_x + index % options.width;
+            tile.y = options.origin_y + index / options.width;
+            TileKey key = { tile.x, tile.y };
+            GenerateTile(options.noise, key, options.page_texels, 1.0 / options.heightmap_size,
+                         &heights[0]);
+            TileStoreEncode(&heights[0], page_size, data, tile.min, tile.max);
+            tile.size = data.size();
+
+            lock_guard<mutex> lock(deliver_mutex);
+            if (!deliver(tile, data)) {
+                failed = true;
+            }
+        }
+    };
+
+    vector<thread> workers;
+    for (int i = 1; i < options.threads; ++i) {
+        workers.push_back(thread(work));
+    }
+    work();
+    for (size_t i = 0; i < workers.size(); ++i) {
+        workers[i].join();
+    }
+    return !failed;
+}
+
+// prints the progress at most twice a second, and always the last time
+class Progress {
+
+    private:
+        int total_;
+        int done_ = 0;
+        uint64_t bytes_ = 0;
+        Clock::time_point start_ = Clock::now();
+        Clock::time_point last_print_ = start_;
+
+    public:
+        Progress(int total) : total_(total) {}
+
+        void Add(uint64_t bytes) {
+            done_++;
+            bytes_ += bytes;
+            Clock::time_point now = Clock::now();
+            if (done_ == total_ || now - last_print_ > chrono::milliseconds(500)) {
+                last_print_ = now;
+                double seconds = Seconds();
+                fprintf(stderr, "\r%d/%d tiles, %.1f tiles/s, %.2f MB/s  ", done_, total_,
+                        done_ / seconds, bytes_ / (1024.0 * 1024.0) / seconds);
+                if (done_ == total_) {
+                    fprintf(stderr, "\n");
+                }
+            }
+        }
+
+        int Done() const {
+            return done_;
+        }
+
+        double Seconds() const {
+            return max(chrono::duration<double>(Clock::now() - start_).count(), 1e-6);
+        }
+};
+
+#ifndef _WIN32
+static bool writeFully(int fd, const void *data, size_t size) {
+    const char *bytes = (const char *) data;
+    while (size > 0) {
+        ssize_t written = write(fd, bytes, size);
+        if (written <= 0) {
+            return false;
+        }
+        bytes += written;
+        size -= written;
+    }
+    return true;
+}
+
+// false at the end of the stream or on error
+static bool readFully(int fd, void *data, size_t size) {
+    char *bytes = (char *) data;
+    while (size > 0) {
+        ssize_t read_size = read(fd, bytes, size);
+        if (read_size <= 0) {
+            return false;
+        }
+        bytes += read_size;
+        size -= read_size;
+    }
+    return true;
+}
+
+// forks a worker per process and writes the tiles as they arrive
+static bool bakeWithProcesses(const BakeOptions &options, TileStoreWriter &writer,
+                              Progress &progress) {
+
+    vector<pid_t> children;
+    vector<pollfd> pipes;
+    for (int rank = 0; rank < options.processes; ++rank) {
+        int fds[2];
+        if (pipe(fds) != 0) {
+            perror("pipe");
+            return false;
+        }
+        fflush(stdout);
+        fflush(stderr);
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            return false;
+        }
+        if (pid == 0) {
+            // the worker only keeps its own write end
+            close(fds[0]);
+            for (size_t i = 0; i < pipes.size(); ++i) {
+                close(pipes[i].fd);
+            }
+            bool ok = bakeShard(options, rank, [&](const BakedTile &tile,
+                                                    const vector<unsigned char> &data) {
+                return writeFully(fds[1], &tile, sizeof(tile)) &&
+                       writeFully(fds[1], &data[0], data.size());
+            });
+            close(fds[1]);
+            _exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+        close(fds[1]);
+        children.push_back(pid);
+        pollfd entry = { fds[0], POLLIN, 0 };
+        pipes.push_back(entry);
+    }
+
+    bool ok = true;
+    vector<unsigned char> data;
+    int open_pipes = pipes.size();
+    while (open_pipes > 0) {
+        if (poll(&pipes[0], pipes.size(), -1) < 0) {
+            perror("poll");
+            ok = false;
+            break;
+        }
+        for (size_t i = 0; i < pipes.size(); ++i) {
+            if (pipes[i].fd < 0 || pipes[i].revents == 0) {
+                continue;
+            }
+            BakedTile tile;
+            if (!readFully(pipes[i].fd, &tile, sizeof(tile))) {
+                close(pipes[i].fd);
+                pipes[i].fd = -1;
+                open_pipes--;
+                continue;
+            }
+            data.resize(tile.size);
+            if (!readFully(pipes[i].fd, &data[0], data.size()) ||
+                !writer.WriteEncoded(tile.x, tile.y, &data[0], data.size(), tile.min, tile.max)) {
+                ok = false;
+                break;
+            }
+            progress.Add(sizeof(tile) + data.size());
+        }
+        if (!ok) {
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < pipes.size(); ++i) {
+        if (pipes[i].fd >= 0) {
+            close(pipes[i].fd);
+        }
+    }
+    for (size_t i = 0; i < children.size(); ++i) {
+        int status = 0;
+        waitpid(children[i], &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+            fprintf(stderr, "Worker process %d failed\n", (int) i);
+            ok = false;
+        }
+    }
+    return ok;
+}
+#endif
+
+// converts a whole store to an image, a row of tiles at a time
+static bool exportImage(const TileStore &store, const char *path, bool pgm) {
+
+    const TileStoreHeader &header = store.Header();
+    int page_texels = header.page_texels;
+    int page_size = page_texels + 2;
+    int image_width = header.width * page_texels;
+
+    float min = 0.0f, max = 0.0f;
+    for (uint32_t ty = 0; ty < header.height; ++ty) {
+        for (uint32_t tx = 0; tx < header.width; ++tx) {
+            const TileStoreEntry *entry = store.Find(header.origin_x + tx, header.origin_y + ty);
+            if (entry == nullptr) {
+                fprintf(stderr, "Tile %u %u is missing\n", tx, ty);
+                return false;
+            }
+            min = (tx == 0 && ty == 0) || entry->min < min ? entry->min : min;
+            max = (tx == 0 && ty == 0) || entry->max > max ? entry->max : max;
+        }
+    }
+
+    FILE *file = fopen(path, "wb");
+    if (file == nullptr) {
+        fprintf(stderr, "Could not open %s for writing\n", path);
+        return false;
+    }
+    if (pgm) {
+        fprintf(file, "P5\n%d %d\n65535\n", image_width, header.height * page_texels);
+    }
+
+    vector<float> page(page_size * page_size);
+    vector<float> rows(page_texels * image_width);
+    vector<unsigned char> line(image_width * 2);
+    float scale = max > min ? 65535.0f / (max - min) : 0.0f;
+    for (int ty = header.height - 1; ty >= 0; --ty) {
+        for (uint32_t tx = 0; tx < header.width; ++tx) {
+            store.Read(header.origin_x + tx, header.origin_y + ty, &page[0]);
+            for (int j = 0; j < page_texels; ++j) {
+                memcpy(&rows[j * image_width + tx * page_texels], &page[(j + 1) * page_size + 1],
+                       page_texels * sizeof(float));
+            }
+        }
+        for (int j = page_texels - 1; j >= 0; --j) {
+            const float *row = &rows[j * image_width];
+            if (!pgm) {
+                fwrite(row, sizeof(float), image_width, file);
+                continue;
+            }
+            // big endian
+            for (int i = 0; i < image_width; ++i) {
+                int value = (int) floor((row[i] - min) * scale + 0.5f);
+                line[2 * i] = (unsigned char) (value >> 8);
+                line[2 * i + 1] = (unsigned char) value;
+            }
+            fwrite(&line[0], 1, line.size(), file);
+        }
+    }
+
+    bool ok = ferror(file) == 0;
+    ok = fclose(file) == 0 && ok;
+    if (!ok) {
+        fprintf(stderr, "Error while writing %s\n", path);
+    }
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+
+    BakeOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // images are converted from a store written next to them
+    bool image = options.format != "tiles";
+    string store_path = image ? options.output + ".tiles.tmp" : options.output;
+
+    TileStoreHeader header;
+    memset(&header, 0, sizeof(header));
+    header.origin_x = options.origin_x;
+    header.origin_y = options.origin_y;
+    header.width = options.width;
+    header.height = options.height;
+    header.page_texels = options.page_texels;
+    header.heightmap_size = options.heightmap_size;
+    header.scale_factor = options.noise.scale_factor;
+    header.H = options.noise.H;
+    header.lacunarity = options.noise.lacunarity;
+    header.octaves = options.noise.octaves;
+    header.cutoff_coef = options.noise.cutoff_coef;
+    header.offset = options.noise.offset;
+
+    TileStoreWriter writer;
+    if (!writer.Create(store_path.c_str(), header)) {
+        return EXIT_FAILURE;
+    }
+
+    int num_tiles = options.width * options.height;
+    printf("Baking %d tiles of %d texels on %d processes of %d threads\n", num_tiles,
+           options.page_texels, options.processes, options.threads);
+    fflush(stdout);
+
+    Progress progress(num_tiles);
+    bool ok;
+#ifndef _WIN32
+    if (options.processes > 1) {
+        ok = bakeWithProcesses(options, writer, progress);
+    } else
+#endif
+    {
+        ok = bakeShard(options, 0, [&](const BakedTile &tile, const vector<unsigned char> &data) {
+            progress.Add(sizeof(tile) + data.size());
+            return writer.WriteEncoded(tile.x, tile.y, &data[0], data.size(), tile.min, tile.max);
+        });
+    }
+    ok = ok && progress.Done() == num_tiles;
+    ok = writer.Finish() && ok;
+    if (!ok) {
+        fprintf(stderr, "Baking failed\n");
+        remove(store_path.c_str());
+        return EXIT_FAILURE;
+    }
+
+    double seconds = progress.Seconds();
+    double texels = (double) num_tiles * options.page_texels * options.page_texels;
+    printf("Baked %d tiles in %.2f s: %.1f tiles/s, %.1f Mtexels/s, %.1f MB written\n", num_tiles,
+           seconds, num_tiles / seconds, texels / seconds / 1e6,
+           writer.BytesWritten() / (1024.0 * 1024.0));
+
+    if (image) {
+        TileStore store;
+        ok = store.Open(store_path.c_str()) &&
+             exportImage(store, options.output.c_str(), options.format == "pgm");
+        store.Close();
+        remove(store_path.c_str());
+        if (!ok) {
+            return EXIT_FAILURE;
+        }
+        printf("Wrote %s\n", options.output.c_str());
+    }
+    return EXIT_SUCCESS;
+}
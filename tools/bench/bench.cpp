@@ -0,0 +1,418 @@
+// Micro-benchmarks of the CPU side hot paths of the terrain: Bezier paths,
+// noise, tile generation and compression, projection and grid setup. Each
+// benchmark is calibrated to run for at least --min-time seconds per
+// repetition; after a discarded warm-up repetition the time per iteration
+// of every repetition is kept, and the median is reported with its spread.
+//
+// usage: bench [--filter <substring>] [--repetitions <n>] [--min-time <seconds>]
+//              [--json <file>]
+//
+// The JSON report has, per benchmark, the iterations per repetition, the
+// items processed per iteration (samples, texels, vertices...) and the
+// statistics of the nanoseconds per iteration.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "glm/glm.hpp"
+#include "config.h"
+#include "bezier.h"
+#include "bezier_path.h"
+#include "grid.h"
+#include "heightmap.h"
+#include "noise.h"
+#include "projection.h"
+#include "tile_store.h"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+struct BenchOptions {
+    string filter;
+    int repetitions = 10;
+    double min_time = 0.1;          // seconds per repetition
+    string output;                  // JSON report, none if empty
+};
+
+// runs the measured work the given number of times
+typedef function<void(long long)> BenchBody;
+
+struct Bench {
+    string name;
+    double items;                   // per iteration
+    BenchBody body;
+};
+
+struct Stats {
+    double min;
+    double p50;
+    double mean;
+    double stddev;
+    double max;
+};
+
+struct BenchResult {
+    string name;
+    long long iterations;           // per repetition
+    double items;
+    Stats ns;                       // per iteration
+};
+
+// keeps the compiler from optimising the measured work away
+static volatile float sink;
+
+static void usage(const char *program) {
+    fprintf(stderr, "usage: %s [--filter <substring>] [--repetitions <n>] "
+                    "[--min-time <seconds>] [--json <file>]\n", program);
+}
+
+static bool parseOptions(int argc, char *argv[], BenchOptions &options) {
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        int remaining = argc - i - 1;
+        if (arg == "--filter" && remaining >= 1) {
+            options.filter = argv[++i];
+        } else if (arg == "--repetitions" && remaining >= 1) {
+            options.repetitions = atoi(argv[++i]);
+        } else if (arg == "--min-time" && remaining >= 1) {
+            options.min_time = atof(argv[++i]);
+        } else if (arg == "--json" && remaining >= 1) {
+            options.output = argv[++i];
+        } else {
+            fprintf(stderr, "Unknown or incomplete option %s\n", arg.c_str());
+            return false;
+        }
+    }
+    if (options.repetitions <= 0 || options.min_time <= 0.0) {
+        fprintf(stderr, "Repetitions and minimum time must be positive\n");
+        return false;
+    }
+    return true;
+}
+
+// the prerecorded flight is only a few dozen points, a longer path of the
+// same kind spreads the evaluations over more splines
+static void buildPath(Bezier &path, int num_points) {
+    for (int i = 0; i < num_points; ++i) {
+        glm::vec3 point(sin(i * 0.7f) * 0.4f, 20.0f + cos(i * 0.3f), cos(i * 0.5f) * 0.4f);
+        path.addControlPoint(point);
+    }
+}
+
+static NoiseParameters initialNoise(int octaves) {
+    NoiseParameters parameters = { INITIAL_SCALE, INITIAL_H, INITIAL_LACUNARITY, octaves,
+                                   INITIAL_CUT_COEFF, INITIAL_OFFSET };
+    return parameters;
+}
+
+static vector<Bench> allBenchmarks() {
+    vector<Bench> benchmarks;
+
+    {
+        shared_ptr<Bezier> path = make_shared<Bezier>();
+        buildPath(*path, 64);
+        const int samples = 1000;
+        benchmarks.push_back({ "bezier/get_bezier", (double) samples, [path](long long iterations) {
+            float end = path->getCount() - 1;
+            float sum = 0.0f;
+            for (long long n = 0; n < iterations; ++n) {
+                for (int i = 0; i < samples; ++i) {
+                    sum += path->getBezier(end * i / samples).x;
+                }
+            }
+            sink = sum;
+        } });
+    }
+
+    // the precomputed path, on the same curve and on a path long enough for
+    // an hour of flight, should cost the same per sample
+    const int path_points[] = { 64, 4096 };
+    for (int points : path_points) {
+        shared_ptr<Bezier> curve = make_shared<Bezier>();
+        buildPath(*curve, points);
+        shared_ptr<BezierPath> path = make_shared<BezierPath>(*curve);
+        const int samples = 1000;
+        string suffix = "/" + to_string(points);
+        benchmarks.push_back({ "bezier/path_build" + suffix, (double) points, [curve](long long iterations) {
+            BezierPath path;
+            for (long long n = 0; n < iterations; ++n) {
+                path.Build(*curve);
+            }
+            sink = path.Length();
+        } });
+        benchmarks.push_back({ "bezier/path_evaluate" + suffix, (double) samples, [path](long long iterations) {
+            vector<float> t(samples);
+            vector<glm::vec3> points(samples);
+            for (int i = 0; i < samples; ++i) {
+                t[i] = path->End() * i / samples;
+            }
+            float sum = 0.0f;
+            for (long long n = 0; n < iterations; ++n) {
+                path->Evaluate(t.data(), samples, points.data());
+                sum += points[n % samples].x;
+            }
+            sink = sum;
+        } });
+        benchmarks.push_back({ "bezier/path_at_distance" + suffix, (double) samples, [path](long long iterations) {
+            vector<float> distances(samples);
+            vector<glm::vec3> points(samples);
+            for (int i = 0; i < samples; ++i) {
+                distances[i] = path->Length() * i / samples;
+            }
+            float sum = 0.0f;
+            for (long long n = 0; n < iterations; ++n) {
+                path->EvaluateAtDistances(distances.data(), samples, points.data());
+                sum += points[n % samples].x;
+            }
+            sink = sum;
+        } });
+    }
+
+    {
+        const int samples = 4096;
+        benchmarks.push_back({ "noise/perlin", (double) samples, [](long long iterations) {
+            float sum = 0.0f;
+            for (long long n = 0; n < iterations; ++n) {
+                for (int i = 0; i < samples; ++i) {
+                    sum += noise::Perlin(i * 0.013f, n * 0.017f - i * 0.007f);
+                }
+            }
+            sink = sum;
+        } });
+    }
+
+    const int octaves[] = { 1, 4, INITIAL_OCTAVES, 12 };
+    for (size_t o = 0; o < sizeof(octaves) / sizeof(octaves[0]); ++o) {
+        NoiseParameters parameters = initialNoise(octaves[o]);
+        const int samples = 1024;
+        char name[64];
+        snprintf(name, sizeof(name), "noise/height_%d_octaves", octaves[o]);
+        benchmarks.push_back({ name, (double) samples, [parameters](long long iterations) {
+            float sum = 0.0f;
+            for (long long n = 0; n < iterations; ++n) {
+                for (int i = 0; i < samples; ++i) {
+                    sum += noise::Height(parameters, i / 1024.0f, (n & 1023) / 1024.0f);
+                }
+            }
+            sink = sum;
+        } });
+    }
+
+    // the Low and High presets
+    const int tile_texels[] = { 128, 384 };
+    for (size_t t = 0; t < sizeof(tile_texels) / sizeof(tile_texels[0]); ++t) {
+        int page_texels = tile_texels[t];
+        int page_size = page_texels + 2;
+        NoiseParameters parameters = initialNoise(INITIAL_OCTAVES);
+        char name[64];
+
+        snprintf(name, sizeof(name), "heightmap/generate_tile_%d", page_texels);
+        benchmarks.push_back({ name, (double) page_size * page_size,
+                               [parameters, page_texels, page_size](long long iterations) {
+            vector<float> heights(page_size * page_size);
+            double texel_size = 1.0 / (page_texels * TILES_PER_VIEW);
+            for (long long n = 0; n < iterations; ++n) {
+                TileKey key = { (int) (n % 7) - 3, (int) (n % 5) - 2 };
+                GenerateTile(parameters, key, page_texels, texel_size, &heights[0]);
+            }
+            sink = heights[0];
+        } });
+
+        // one tile, compressed once beforehand for the decoder
+        vector<float> heights(page_size * page_size);
+        TileKey key = { 1, 2 };
+        GenerateTile(parameters, key, page_texels, 1.0 / (page_texels * TILES_PER_VIEW), &heights[0]);
+        vector<unsigned char> encoded;
+        float min, max;
+        TileStoreEncode(&heights[0], page_size, encoded, min, max);
+
+        snprintf(name, sizeof(name), "tile_store/encode_%d", page_texels);
+        benchmarks.push_back({ name, (double) page_size * page_size,
+                               [heights, page_size](long long iterations) {
+            vector<unsigned char> data;
+            float min, max;
+            for (long long n = 0; n < iterations; ++n) {
+                TileStoreEncode(&heights[0], page_size, data, min, max);
+            }
+            sink = data.size();
+        } });
+
+        snprintf(name, sizeof(name), "tile_store/decode_%d", page_texels);
+        benchmarks.push_back({ name, (double) page_size * page_size,
+                               [encoded, page_size, min, max](long long iterations) {
+            vector<float> decoded(page_size * page_size);
+            for (long long n = 0; n < iterations; ++n) {
+                TileStoreDecode(&encoded[0], encoded.size(), page_size, min, max, &decoded[0]);
+            }
+            sink = decoded[0];
+        } });
+    }
+
+    {
+        const int matrices = 1000;
+        benchmarks.push_back({ "projection/perspective", (double) matrices, [](long long iterations) {
+            float sum = 0.0f;
+            for (long long n = 0; n < iterations; ++n) {
+                for (int i = 0; i < matrices; ++i) {
+                    float aspect = 1.0f + i * 0.001f;
+                    sum += PerspectiveProjection(START_CAM_FOV, aspect, CAM_NEAR, CAM_FAR)[0][0];
+                }
+            }
+            sink = sum;
+        } });
+    }
+
+    {
+        // Terrain::Init and the default Water::Init
+        const int terrain_resolution = 256;
+        const int water_resolution = RESOLUTION;
+        benchmarks.push_back({ "grid/terrain_patches", (double) terrain_resolution * terrain_resolution,
+                               [terrain_resolution](long long iterations) {
+            for (long long n = 0; n < iterations; ++n) {
+                vector<float> vertices;
+                vector<unsigned int> indices;
+                BuildPatchGrid(terrain_resolution, WORLD_SIZE, vertices, indices);
+                sink = indices.size();
+            }
+        } });
+        benchmarks.push_back({ "grid/water_strip", (double) water_resolution * water_resolution,
+                               [water_resolution](long long iterations) {
+            for (long long n = 0; n < iterations; ++n) {
+                vector<float> vertices;
+                vector<unsigned int> indices;
+                BuildStripGrid(water_resolution, WORLD_SIZE, vertices, indices);
+                sink = indices.size();
+            }
+        } });
+    }
+
+    return benchmarks;
+}
+
+static double seconds(const BenchBody &body, long long iterations) {
+    Clock::time_point start = Clock::now();
+    body(iterations);
+    return chrono::duration<double>(Clock::now() - start).count();
+}
+
+// doubles the iterations until a run takes a tenth of the minimum time,
+// then scales them up to the minimum time
+static long long calibrate(const BenchBody &body, double min_time) {
+    long long iterations = 1;
+    while (true) {
+        double elapsed = seconds(body, iterations);
+        if (elapsed >= min_time / 10.0 || iterations >= (1LL << 40)) {
+            double scaled = iterations * min_time / max(elapsed, 1e-9);
+            return max(1LL, (long long) ceil(scaled));
+        }
+        iterations *= 2;
+    }
+}
+
+static Stats computeStats(vector<double> values) {
+    Stats stats = {};
+    if (values.empty()) {
+        return stats;
+    }
+    sort(values.begin(), values.end());
+    double sum = 0.0;
+    for (size_t i = 0; i < values.size(); ++i) {
+        sum += values[i];
+    }
+    stats.min = values.front();
+    stats.max = values.back();
+    stats.mean = sum / values.size();
+    size_t middle = values.size() / 2;
+    stats.p50 = values.size() % 2 ? values[middle] : (values[middle - 1] + values[middle]) / 2.0;
+    double variance = 0.0;
+    for (size_t i = 0; i < values.size(); ++i) {
+        variance += (values[i] - stats.mean) * (values[i] - stats.mean);
+    }
+    stats.stddev = values.size() > 1 ? sqrt(variance / (values.size() - 1)) : 0.0;
+    return stats;
+}
+
+static BenchResult run(const Bench &bench, const BenchOptions &options) {
+    BenchResult result;
+    result.name = bench.name;
+    result.items = bench.items;
+    result.iterations = calibrate(bench.body, options.min_time);
+
+    // the warm-up repetition is not kept
+    seconds(bench.body, result.iterations);
+    vector<double> ns;
+    for (int i = 0; i < options.repetitions; ++i) {
+        ns.push_back(seconds(bench.body, result.iterations) * 1e9 / result.iterations);
+    }
+    result.ns = computeStats(ns);
+    return result;
+}
+
+static bool writeReport(const vector<BenchResult> &results, const BenchOptions &options) {
+    FILE *out = fopen(options.output.c_str(), "w");
+    if (out == NULL) {
+        fprintf(stderr, "Could not write %s\n", options.output.c_str());
+        return false;
+    }
+    fprintf(out, "{\n");
+    fprintf(out, "  \"repetitions\": %d,\n  \"min_time\": %.4f,\n", options.repetitions,
+            options.min_time);
+    fprintf(out, "  \"benchmarks\": {\n");
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult &result = results[i];
+        const Stats &ns = result.ns;
+        fprintf(out, "    \"%s\": { \"iterations\": %lld, \"items\": %.0f, ",
+                result.name.c_str(), result.iterations, result.items);
+        fprintf(out, "\"ns\": { \"min\": %.2f, \"p50\": %.2f, \"mean\": %.2f, "
+                     "\"stddev\": %.2f, \"max\": %.2f }, ",
+                ns.min, ns.p50, ns.mean, ns.stddev, ns.max);
+        fprintf(out, "\"items_per_second\": %.1f }%s\n", result.items * 1e9 / ns.p50,
+                i + 1 < results.size() ? "," : "");
+    }
+    fprintf(out, "  }\n}\n");
+    fclose(out);
+    printf("Benchmark report written to %s\n", options.output.c_str());
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    BenchOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    vector<Bench> benchmarks = allBenchmarks();
+    vector<BenchResult> results;
+    printf("%-28s %12s %14s %8s %16s\n", "benchmark", "iterations", "ns/iteration", "+-",
+           "items/s");
+    for (size_t i = 0; i < benchmarks.size(); ++i) {
+        if (benchmarks[i].name.find(options.filter) == string::npos) {
+            continue;
+        }
+        BenchResult result = run(benchmarks[i], options);
+        // spread as the coefficient of variation
+        printf("%-28s %12lld %14.1f %7.1f%% %16.4g\n", result.name.c_str(), result.iterations,
+               result.ns.p50, 100.0 * result.ns.stddev / result.ns.mean,
+               result.items * 1e9 / result.ns.p50);
+        fflush(stdout);
+        results.push_back(result);
+    }
+
+    if (results.empty()) {
+        fprintf(stderr, "No benchmark matches %s\n", options.filter.c_str());
+        return EXIT_FAILURE;
+    }
+    if (!options.output.empty() && !writeReport(results, options)) {
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}